@@ -0,0 +1,21 @@
+#include <pretty/plot.hpp>
+#include <pretty/annotations.hpp>
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+int main()
+{
+	pretty::paragraph("A plot of 1000000 points");
+
+	std::vector<std::pair<double, double>> points(1000000);
+	for(size_t k = 0; k != std::size(points); ++k)
+	{
+		auto const x = static_cast<double>(k)/static_cast<double>(std::size(points));
+		points[k] = std::pair{x, std::sin(20.0*x)};
+	}
+
+	pretty::figure fig{"sin(20x)"};
+	pretty::plot(points);
+}
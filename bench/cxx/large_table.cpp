@@ -0,0 +1,19 @@
+#include <pretty/base.hpp>
+#include <pretty/annotations.hpp>
+
+#include <array>
+#include <vector>
+
+int main()
+{
+	pretty::paragraph("A table with 200000 rows of 8 doubles");
+
+	std::vector<std::array<double, 8>> rows(200000);
+	for(size_t k = 0; k != std::size(rows); ++k)
+	{
+		for(size_t l = 0; l != std::size(rows[k]); ++l)
+		{ rows[k][l] = static_cast<double>(k)/static_cast<double>(l + 1); }
+	}
+
+	pretty::print(rows);
+}
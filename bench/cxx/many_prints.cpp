@@ -0,0 +1,10 @@
+#include <pretty/base.hpp>
+#include <pretty/annotations.hpp>
+
+int main()
+{
+	pretty::paragraph("100000 separate calls to print");
+
+	for(int k = 0; k != 100000; ++k)
+	{ PRETTY_PRINT_EXPR(k); }
+}
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+
+'''Measures the full loop of the workbench: POST to /build_and_run, compile, run, and stream the
+output page until it is complete. The server is started without a browser, and every program in
+samples/cxx and bench/cxx is built and run a number of times. The results are written as JSON.'''
+
+import argparse
+import http.client
+import json
+import os
+import secrets
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+import zlib
+from pathlib import Path
+
+app_dir = Path(__file__).parents[1]
+
+compile_done_marker = b'<p>Program compiled successfully</p>'
+exit_ok_marker = b'<p>Program exited normally</p>'
+
+def find_free_port():
+	with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as sock:
+		sock.bind(('127.0.0.1', 0))
+		return sock.getsockname()[1]
+
+# The stress programs write far more than the default output window. Keep all of it inline, so
+# that the benchmark measures the transfer rather than placeholders.
+default_server_args = ['--output-window', '4096', '--max-inline-fragment', '4096']
+
+def start_server(port, api_key_file, cache_dir, server_args):
+	# The key is passed in a file, since the command line is visible to other users
+	server = subprocess.Popen([sys.executable, str(app_dir / 'server' / 'main.py'),
+		'--port', str(port),
+		'--api-key-file', api_key_file,
+		'--no-browser',
+		'--object-cache', cache_dir] + default_server_args + server_args,
+		stdout = subprocess.DEVNULL,
+		stdin = subprocess.DEVNULL)
+
+	deadline = time.monotonic() + 10.0
+	while time.monotonic() < deadline:
+		try:
+			with socket.create_connection(('127.0.0.1', port), timeout = 0.1):
+				return server
+		except OSError:
+			time.sleep(0.05)
+	server.kill()
+	raise RuntimeError('Server did not start')
+
+def make_form(fields):
+	boundary = secrets.token_hex(16)
+	body = b''
+	for name, value in fields.items():
+		body += b'--%s\r\nContent-Disposition: form-data; name="%s"\r\n\r\n%s\r\n'%(
+			boundary.encode('utf-8'), name.encode('utf-8'), value.encode('utf-8'))
+	body += b'--%s--\r\n'%boundary.encode('utf-8')
+	return ('multipart/form-data; boundary=%s'%boundary, body)
+
+def build_and_run(port, api_key, filename, source, accept_encoding):
+	content_type, body = make_form({'api_key': api_key, 'filename': str(filename),
+		'source': source})
+	connection = http.client.HTTPConnection('127.0.0.1', port)
+	t_start = time.perf_counter()
+	connection.request('POST', '/build_and_run', body, {'Content-Type': content_type,
+		'Accept-Encoding': accept_encoding})
+	response = connection.getresponse()
+	content_encoding = response.getheader('Content-Encoding')
+	decompressor = None
+	if content_encoding == 'gzip':
+		decompressor = zlib.decompressobj(wbits = 16 + zlib.MAX_WBITS)
+	elif content_encoding == 'deflate':
+		decompressor = zlib.decompressobj(wbits = zlib.MAX_WBITS)
+
+	t_first_byte = None
+	t_compiled = None
+	size = 0
+	# Keep the end of the previous read, in case a marker is split between two reads
+	tail = b''
+	exit_ok = False
+	while (buffer := response.read1(65536)):
+		now = time.perf_counter()
+		if t_first_byte == None:
+			t_first_byte = now
+		# The size is what went over the wire, while markers are found in the decoded page
+		size += len(buffer)
+		if decompressor != None:
+			buffer = decompressor.decompress(buffer)
+		scan = tail + buffer
+		if t_compiled == None and compile_done_marker in scan:
+			t_compiled = now
+		if exit_ok_marker in scan:
+			exit_ok = True
+		tail = scan[-64:]
+	t_end = time.perf_counter()
+	connection.close()
+
+	return {
+		'compile_time': None if t_compiled == None else t_compiled - t_start,
+		'time_to_first_byte': None if t_first_byte == None else t_first_byte - t_start,
+		'total_time': t_end - t_start,
+		'response_size': size,
+		'compiled': t_compiled != None,
+		'exited_normally': exit_ok
+	}
+
+def summarize(runs):
+	ret = {}
+	for metric in ['compile_time', 'time_to_first_byte', 'total_time', 'response_size']:
+		values = [run[metric] for run in runs if run[metric] != None]
+		if len(values) != 0:
+			ret[metric] = {'min': min(values), 'median': statistics.median(values),
+				'max': max(values)}
+	ret['succeeded'] = sum(1 for run in runs if run['exited_normally'])
+	return ret
+
+def collect_programs(dirs):
+	ret = []
+	for src_dir in dirs:
+		ret.extend(sorted(Path(src_dir).glob('*.cpp')))
+	return ret
+
+def main():
+	parser = argparse.ArgumentParser(description = __doc__)
+	parser.add_argument('--runs', type = int, default = 5,
+		help = 'Number of times each program is built and run')
+	parser.add_argument('--warm', action = 'store_true',
+		help = 'Let repeated runs use the object cache. By default, every run compiles.')
+	parser.add_argument('--accept-encoding', default = 'identity',
+		help = 'Accept-Encoding header sent with the requests')
+	parser.add_argument('--output', default = 'bench_end_to_end.json',
+		help = 'Where to write the report')
+	parser.add_argument('--program-dir', action = 'append',
+		help = 'Directory with programs to run. May be repeated. ' +
+			'Defaults to samples/cxx and bench/cxx.')
+	parser.add_argument('server_args', nargs = '*',
+		help = 'Extra arguments passed to the server, after --. These override the output limits '
+			'that the benchmark sets.')
+	args = parser.parse_args()
+	root_dir = app_dir.resolve()
+
+	programs = collect_programs(args.program_dir or
+		[app_dir / 'samples' / 'cxx', app_dir / 'bench' / 'cxx'])
+	port = find_free_port()
+	api_key = secrets.token_hex()
+	report = {
+		'server_args': args.server_args,
+		'accept_encoding': args.accept_encoding,
+		'warm': args.warm,
+		'programs': {}
+	}
+
+	with tempfile.TemporaryDirectory() as temp_dir:
+		cache_dir = os.path.join(temp_dir, 'objects')
+		api_key_file = os.path.join(temp_dir, 'api_key')
+		with open(os.open(api_key_file, os.O_WRONLY | os.O_CREAT, 0o600), 'w') as f:
+			f.write(api_key)
+		server = start_server(port, api_key_file, cache_dir, args.server_args)
+		try:
+			for program in programs:
+				source = program.read_bytes().decode('utf-8')
+				runs = []
+				for k in range(0, args.runs):
+					# A unique comment changes the cache key, so that every run compiles
+					run_source = source if args.warm else '%s\n// run %d %s\n'%(source, k,
+						secrets.token_hex(8))
+					runs.append(build_and_run(port, api_key, program, run_source,
+						args.accept_encoding))
+
+				program_path = program.resolve()
+				name = str(program_path.relative_to(root_dir)
+					if program_path.is_relative_to(root_dir) else program.name)
+				summary = summarize(runs)
+				report['programs'][name] = {'runs': runs, 'summary': summary}
+				print('%-32s compile %7s  ttfb %7s  total %7s  size %10d  ok %d/%d'%(name,
+					'%.3f'%summary['compile_time']['median'] if 'compile_time' in summary else '-',
+					'%.3f'%summary['time_to_first_byte']['median'],
+					'%.3f'%summary['total_time']['median'],
+					summary['response_size']['median'], summary['succeeded'], len(runs)))
+		finally:
+			server.terminate()
+			server.wait()
+
+	with open(args.output, 'w') as f:
+		json.dump(report, f, indent = '\t')
+
+if __name__ == '__main__':
+	main()
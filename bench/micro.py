@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+
+'''Builds and runs the formatting micro-benchmarks in bench/micro. Output from the library goes
+to a counting sink, so the numbers reflect formatting throughput only. The results are written as
+JSON, and can be compared against the report from another commit.'''
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+app_dir = Path(__file__).parents[1]
+
+# Same options as the server uses when building programs
+cxx_flags = ['-std=c++20', '-O3', '-ffast-math', '-Wall', '-Wextra', '-Wconversion', '-Werror']
+
+def get_output(args):
+	try:
+		return subprocess.run(args, capture_output = True, check = True,
+			cwd = app_dir).stdout.decode('utf-8').strip()
+	except (OSError, subprocess.CalledProcessError):
+		return None
+
+def build(src_file, exec_name, compiler):
+	subprocess.run([compiler, '-I%s'%(app_dir / 'lib' / 'cxx')] + cxx_flags +
+		[str(src_file), '-o', str(exec_name)], check = True)
+
+def run(exec_name, max_plot_exponent, min_time):
+	env = dict(os.environ)
+	env['PRETTY_BENCH_MIN_TIME'] = str(min_time)
+	output = subprocess.run([str(exec_name), str(max_plot_exponent)], capture_output = True,
+		check = True, env = env).stdout.decode('utf-8')
+	return [json.loads(line) for line in output.splitlines() if len(line) != 0]
+
+def compare(results, baseline_file):
+	with open(baseline_file, 'rb') as f:
+		baseline = {item['name']: item for item in json.load(f)['results']}
+
+	print('\n%-28s %14s %14s %8s'%('benchmark', 'baseline ns', 'current ns', 'ratio'))
+	for item in results:
+		ref = baseline.get(item['name'])
+		if ref == None:
+			continue
+		print('%-28s %14.2f %14.2f %8.3f'%(item['name'], ref['ns_per_element'],
+			item['ns_per_element'], item['ns_per_element']/ref['ns_per_element']))
+
+def main():
+	parser = argparse.ArgumentParser(description = __doc__)
+	parser.add_argument('--compiler', default = 'g++')
+	parser.add_argument('--max-plot-exponent', type = int, default = 7,
+		help = 'The largest plot has 10^N points')
+	parser.add_argument('--min-time', type = float, default = 0.25,
+		help = 'Minimum time, in seconds, spent in each benchmark')
+	parser.add_argument('--output', default = 'bench_output.json',
+		help = 'Where to write the report')
+	parser.add_argument('--baseline',
+		help = 'Report from an earlier run to compare against')
+	args = parser.parse_args()
+
+	with tempfile.TemporaryDirectory() as temp_dir:
+		exec_name = Path(temp_dir) / 'formatting'
+		build(app_dir / 'bench' / 'micro' / 'formatting.cpp', exec_name, args.compiler)
+		results = run(exec_name, args.max_plot_exponent, args.min_time)
+
+	print('%-28s %12s %14s %10s'%('benchmark', 'elements', 'ns/element', 'MB/s'))
+	for item in results:
+		print('%-28s %12d %14.2f %10.1f'%(item['name'], item['elements'], item['ns_per_element'],
+			item['mb_per_second']))
+
+	report = {
+		'commit': get_output(['git', 'rev-parse', 'HEAD']),
+		'compiler': get_output([args.compiler, '--version']),
+		'flags': cxx_flags,
+		'results': results
+	}
+	with open(args.output, 'w') as f:
+		json.dump(report, f, indent = '\t')
+
+	if args.baseline != None:
+		compare(results, args.baseline)
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,141 @@
+#include "./harness.hpp"
+
+#include <pretty/base.hpp>
+#include <pretty/plot.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+	// The largest plot is 10^max_plot_exponent points
+	auto const max_plot_exponent = argc > 1 ? atoi(argv[1]) : 7;
+
+	pretty_bench::init();
+
+	{
+		std::string const str(1 << 20, 'a');
+		pretty_bench::run("string_clean", std::size(str), [&str](){
+			pretty::write_as_html(str);
+		});
+	}
+
+	{
+		std::string str;
+		while(std::size(str) < (1 << 20))
+		{ str += "<a href=\"x\">&amp;</a>"; }
+		pretty_bench::run("string_escape_heavy", std::size(str), [&str](){
+			pretty::write_as_html(str);
+		});
+	}
+
+	{
+		std::vector<int64_t> vals(1000000);
+		for(size_t k = 0; k != std::size(vals); ++k)
+		{ vals[k] = static_cast<int64_t>(k*2654435761u) - (int64_t{1} << 40); }
+		pretty_bench::run("integers", std::size(vals), [&vals](){
+			for(auto val : vals)
+			{ pretty::write_as_html(val); }
+		});
+	}
+
+	{
+		std::vector<double> vals(1000000);
+		for(size_t k = 0; k != std::size(vals); ++k)
+		{ vals[k] = std::sin(static_cast<double>(k))*1.0e3; }
+		pretty_bench::run("floats", std::size(vals), [&vals](){
+			for(auto val : vals)
+			{ pretty::write_as_html(val); }
+		});
+	}
+
+	{
+		std::vector<std::byte> vals(1000000);
+		for(size_t k = 0; k != std::size(vals); ++k)
+		{ vals[k] = static_cast<std::byte>(k); }
+		pretty_bench::run("bytes", std::size(vals), [&vals](){
+			for(auto val : vals)
+			{ pretty::write_as_html(val); }
+		});
+	}
+
+	{
+		std::vector<int> vals(1000000);
+		for(size_t k = 0; k != std::size(vals); ++k)
+		{ vals[k] = static_cast<int>(k); }
+		pretty_bench::run("vector_of_int", std::size(vals), [&vals](){
+			pretty::write_as_html(vals);
+		});
+	}
+
+	{
+		std::vector<std::array<double, 8>> rows(125000);
+		for(size_t k = 0; k != std::size(rows); ++k)
+		{
+			for(size_t l = 0; l != std::size(rows[k]); ++l)
+			{ rows[k][l] = static_cast<double>(k)/static_cast<double>(l + 1); }
+		}
+		pretty_bench::run("table_of_array_double_8", 8*std::size(rows), [&rows](){
+			pretty::write_as_html(rows);
+		});
+	}
+
+	{
+		std::vector<std::vector<int>> rows(1000);
+		for(size_t k = 0; k != std::size(rows); ++k)
+		{ rows[k].resize(1 + k%17, static_cast<int>(k)); }
+		size_t element_count = 0;
+		for(auto const& row : rows)
+		{ element_count += std::size(row); }
+		pretty_bench::run("nested_vector_ragged", element_count, [&rows](){
+			pretty::write_as_html(rows);
+		});
+	}
+
+	{
+		std::map<std::string, std::array<int, 3>> vals;
+		for(int k = 0; k != 100000; ++k)
+		{ vals[std::to_string(k)] = std::array<int, 3>{k, 2*k, 3*k}; }
+		pretty_bench::run("map_string_to_array", std::size(vals), [&vals](){
+			pretty::write_as_html(vals);
+		});
+	}
+
+	{
+		std::vector<std::tuple<int, double, std::string>> vals;
+		for(int k = 0; k != 100000; ++k)
+		{ vals.push_back(std::tuple{k, 0.5*k, std::to_string(k)}); }
+		pretty_bench::run("vector_of_tuple", std::size(vals), [&vals](){
+			pretty::write_as_html(vals);
+		});
+	}
+
+	{
+		constexpr size_t count = 100000;
+		pretty_bench::run("print_labeled_value", count, [](){
+			for(size_t k = 0; k != count; ++k)
+			{ pretty::print_labeled_value("k", k); }
+		});
+	}
+
+	for(int exponent = 3; exponent <= max_plot_exponent; ++exponent)
+	{
+		auto const count = static_cast<size_t>(std::pow(10.0, exponent));
+		std::vector<std::pair<double, double>> points(count);
+		for(size_t k = 0; k != count; ++k)
+		{
+			auto const x = static_cast<double>(k)/static_cast<double>(count);
+			points[k] = std::pair{x, std::sin(20.0*x)};
+		}
+		auto const name = "plot_1e" + std::to_string(exponent);
+		pretty_bench::run(name, count, [&points](){
+			pretty::plot(points);
+		});
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef PRETTY_BENCH_HARNESS_HPP
+#define PRETTY_BENCH_HARNESS_HPP
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+namespace pretty_bench
+{
+	// Counts the bytes written to it, and throws them away
+	struct counting_sink
+	{
+		size_t bytes{0};
+	};
+
+	inline counting_sink sink{};
+
+	inline FILE* results = nullptr;
+
+	// Replaces stdout with a counting sink, so that only formatting is measured. Results are
+	// written to the original stdout.
+	inline void init()
+	{
+		fflush(stdout);
+		results = fdopen(dup(STDOUT_FILENO), "w");
+
+		cookie_io_functions_t const functions{
+			.read = nullptr,
+			.write = [](void* cookie, char const*, size_t n) -> ssize_t {
+				static_cast<counting_sink*>(cookie)->bytes += n;
+				return static_cast<ssize_t>(n);
+			},
+			.seek = nullptr,
+			.close = nullptr
+		};
+		stdout = fopencookie(&sink, "w", functions);
+		setvbuf(stdout, nullptr, _IOFBF, 65536);
+	}
+
+	inline double min_time = [](){
+		auto const val = getenv("PRETTY_BENCH_MIN_TIME");
+		return val != nullptr? atof(val) : 0.25;
+	}();
+
+	// Runs func until at least min_time seconds have passed, and reports the fastest iteration
+	template<class Function>
+	void run(std::string_view name, size_t element_count, Function&& func)
+	{
+		std::vector<double> times;
+		size_t bytes = 0;
+		auto const t_start = std::chrono::steady_clock::now();
+		do
+		{
+			fflush(stdout);
+			auto const bytes_before = sink.bytes;
+			auto const t0 = std::chrono::steady_clock::now();
+			func();
+			fflush(stdout);
+			auto const t1 = std::chrono::steady_clock::now();
+			bytes = sink.bytes - bytes_before;
+			times.push_back(std::chrono::duration<double>(t1 - t0).count());
+		}
+		while(std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count() < min_time);
+
+		auto const best = *std::ranges::min_element(times);
+		fprintf(results, "{\"name\": \"%.*s\", \"elements\": %zu, \"bytes\": %zu, \"iterations\": %zu, "
+			"\"seconds\": %.9g, \"ns_per_element\": %.6g, \"mb_per_second\": %.6g}\n",
+			static_cast<int>(std::size(name)), std::data(name), element_count, bytes, std::size(times),
+			best,
+			1.0e9*best/static_cast<double>(element_count),
+			static_cast<double>(bytes)/(1.0e6*best));
+		fflush(results);
+	}
+}
+
+#endif
@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+
+'''Serves a page that streams large tables through the real output header, slowly enough that the
+browser parses them in many steps. Open the printed address in a browser. When the page has loaded,
+it checks that the tables were virtualized while they were still loading, that every row is kept,
+and that scrolling renders the right rows. The result is shown at the top of the page and in its
+title.'''
+
+import argparse
+import http.server
+import sys
+import time
+from pathlib import Path
+
+app_dir = Path(__file__).parents[1]
+sys.path.insert(0, str(app_dir / 'server'))
+
+import template_file
+
+api_key = 'virtual_table_page'
+
+# Runs before any output arrives, and records the largest number of rows that were in the document
+monitor_script = b'''<script>
+let max_connected_rows = 0;
+const row_monitor = new MutationObserver(() => {
+	max_connected_rows = Math.max(max_connected_rows, document.getElementsByTagName("tr").length);
+});
+row_monitor.observe(document.documentElement, {childList: true, subtree: true});
+</script>
+<p id="result">Loading</p>
+'''
+
+check_script = b'''<script>
+function check_page(row_count, table_count)
+{
+	const errors = [];
+	if(virtual_tables.length !== table_count)
+	{ errors.push(`${virtual_tables.length} virtualized tables, expected ${table_count}`); }
+	if(new Set(virtual_tables.map(item => item.body)).size !== virtual_tables.length)
+	{ errors.push("A table body was virtualized twice"); }
+	for(const table of virtual_tables)
+	{
+		if(table.rows.length !== row_count)
+		{ errors.push(`A table kept ${table.rows.length} rows, expected ${row_count}`); }
+	}
+	if(max_connected_rows > row_count/2)
+	{ errors.push(`Up to ${max_connected_rows} rows were in the document while loading`); }
+
+	// Scroll to the middle of the first table, and check which rows are rendered
+	stick_to_bottom = false;
+	const table = virtual_tables[0];
+	const middle = Math.floor(row_count/2);
+	window.scrollTo(0, table.body.getBoundingClientRect().top + window.scrollY
+		+ middle*table.row_height);
+	requestAnimationFrame(() => requestAnimationFrame(() => {
+		const rendered = Array.from(table.body.rows).filter(row => row.className !== "spacer");
+		const indices = rendered.map(row => Number(row.cells[0].textContent));
+		if(!indices.includes(middle))
+		{ errors.push(`Row ${middle} is not rendered after scrolling to it`); }
+		if(indices.some((value, k) => value !== indices[0] + k))
+		{ errors.push("Rendered rows are not contiguous"); }
+
+		const result = document.getElementById("result");
+		result.textContent = errors.length === 0 ? "PASS" : "FAIL: " + errors.join("; ");
+		document.title = result.textContent;
+	}));
+}
+window.addEventListener("load", () => setTimeout(check_page, 100, %d, %d));
+</script>
+'''
+
+def make_row(k):
+	return b'<tr>\n<td>%d</td>%s</tr>\n'%(k,
+		b''.join(b'<td>%g</td>'%(k/(l + 1)) for l in range(1, 8)))
+
+class Handler(http.server.BaseHTTPRequestHandler):
+	def do_GET(self):
+		if self.path.startswith('/document.css'):
+			self.send_response(200)
+			self.send_header('Content-Type', 'text/css')
+			self.end_headers()
+			self.wfile.write((app_dir / 'client' / 'document.css').read_bytes())
+			return
+
+		self.send_response(200)
+		self.send_header('Content-Type', 'text/html; charset=utf-8')
+		self.end_headers()
+		self.wfile.write(b'<!DOCTYPE html>\n<html lang="en">\n<head>\n<meta charset="UTF-8">\n')
+		self.wfile.write(template_file.string_from_template_file(
+			app_dir / 'client' / 'output_header.html', {'api_key': api_key}).encode('utf-8'))
+		self.wfile.write(b'</head>\n<body>\n<h1>Virtual table test</h1>\n')
+		self.wfile.write(monitor_script)
+
+		# The second table is nested in a row of a small table, so it is found twice: on its own,
+		# and as part of its parent
+		for table_index, (prefix, suffix) in enumerate([
+			(b'', b''),
+			(b'<table class="range_content">\n<tr>\n<td>\n', b'</td>\n</tr>\n</table>\n')]):
+			self.wfile.write(prefix)
+			self.wfile.write(b'<table class="range_content">\n')
+			for first in range(0, self.server.row_count, self.server.chunk_size):
+				last = min(first + self.server.chunk_size, self.server.row_count)
+				self.wfile.write(b''.join(make_row(k) for k in range(first, last)))
+				self.wfile.flush()
+				time.sleep(self.server.delay)
+			self.wfile.write(b'</table>\n')
+			self.wfile.write(suffix)
+
+		self.wfile.write(check_script%(self.server.row_count, 2))
+		self.wfile.write(b'</body>\n</html>\n')
+
+def main():
+	parser = argparse.ArgumentParser(description = __doc__)
+	parser.add_argument('--port', type = int, default = 8765)
+	parser.add_argument('--rows', type = int, default = 200000,
+		help = 'Number of rows in each table')
+	parser.add_argument('--chunk-size', type = int, default = 2000,
+		help = 'Number of rows sent at a time')
+	parser.add_argument('--delay', type = float, default = 0.02,
+		help = 'Time to wait between chunks, in seconds')
+	args = parser.parse_args()
+
+	server = http.server.ThreadingHTTPServer(('127.0.0.1', args.port), Handler)
+	server.row_count = args.rows
+	server.chunk_size = args.chunk_size
+	server.delay = args.delay
+	print('Open http://127.0.0.1:%d/ in a browser'%args.port, flush = True)
+	server.serve_forever()
+
+if __name__ == '__main__':
+	main()
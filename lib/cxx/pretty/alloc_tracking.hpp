@@ -0,0 +1,241 @@
+#ifndef PRETTY_ALLOC_TRACKING_HPP
+#define PRETTY_ALLOC_TRACKING_HPP
+
+// Counts heap allocations made by the current thread. This needs replacements of the global
+// operator new and operator delete, which must be defined exactly once in a program. Define
+// PRETTY_DEFINE_ALLOCATION_TRACKING_OPERATORS before including this header in the one source that
+// should define them.
+
+#include "./base.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <string>
+
+namespace pretty
+{
+	namespace detail
+	{
+		// Size class k holds allocations of at most 2^k bytes
+		inline constexpr size_t alloc_size_class_count = 48;
+
+		struct alloc_counters
+		{
+			size_t count;
+			size_t bytes;
+			// May go negative, if the thread frees memory allocated by another thread
+			int64_t live_bytes;
+			int64_t peak_live_bytes;
+			std::array<size_t, alloc_size_class_count> size_classes;
+		};
+
+		inline constinit thread_local alloc_counters current_alloc_counters{};
+
+		inline void count_allocation(size_t size)
+		{
+			auto& counters = current_alloc_counters;
+			++counters.count;
+			counters.bytes += size;
+			counters.live_bytes += static_cast<int64_t>(size);
+			counters.peak_live_bytes = std::max(counters.peak_live_bytes, counters.live_bytes);
+			auto const size_class = std::min(static_cast<size_t>(std::bit_width(size > 0 ? size - 1 : 0)),
+				alloc_size_class_count - 1);
+			++counters.size_classes[size_class];
+		}
+
+		// Every block starts with a header, so that the pointer handed out keeps the alignment of
+		// the block. The word in front of that pointer holds the requested size, shifted left by
+		// one, and whether the allocation was counted in the lowest bit. Memory allocated while
+		// writing output is not counted, and so not subtracted when it is freed, wherever that
+		// happens.
+		inline size_t alloc_header_size(size_t alignment)
+		{ return std::max(alignment, alignof(std::max_align_t)); }
+
+		inline void* allocate(size_t size, size_t alignment)
+		{
+			auto const header_size = alloc_header_size(alignment);
+			if(size > std::numeric_limits<size_t>::max()/2 - header_size)
+			{ return nullptr; }
+
+			while(true)
+			{
+				auto const block = alignment <= alignof(std::max_align_t) ? malloc(header_size + size)
+					: aligned_alloc(alignment, (header_size + size + alignment - 1)/alignment*alignment);
+				if(block != nullptr)
+				{
+					auto const ret = static_cast<std::byte*>(block) + header_size;
+					auto const counted = atomic_write_depth == 0;
+					reinterpret_cast<size_t*>(ret)[-1] = size << 1 | static_cast<size_t>(counted);
+					if(counted)
+					{ count_allocation(size); }
+					return ret;
+				}
+
+				auto const handler = std::get_new_handler();
+				if(handler == nullptr)
+				{ return nullptr; }
+				handler();
+			}
+		}
+
+		inline void* allocate_or_throw(size_t size, size_t alignment)
+		{
+			auto const ret = allocate(size, alignment);
+			if(ret == nullptr)
+			{ throw std::bad_alloc{}; }
+			return ret;
+		}
+
+		inline void deallocate(void* ptr, size_t alignment)
+		{
+			if(ptr == nullptr)
+			{ return; }
+
+			auto const header = reinterpret_cast<size_t const*>(ptr)[-1];
+			if((header & 1) != 0)
+			{ current_alloc_counters.live_bytes -= static_cast<int64_t>(header >> 1); }
+			free(static_cast<std::byte*>(ptr) - alloc_header_size(alignment));
+		}
+	}
+
+	// Prints the number of allocations, the number of bytes requested, the peak of live heap
+	// memory, and a histogram of allocation sizes, when it goes out of scope. Only allocations made
+	// by the current thread are counted, and output written by the library is excluded. Nothing is
+	// counted unless PRETTY_DEFINE_ALLOCATION_TRACKING_OPERATORS is defined in one source.
+	class alloc_scope
+	{
+	public:
+		[[nodiscard]] explicit alloc_scope(std::string_view name = "Allocations"):
+			m_name{name},
+			m_start{detail::current_alloc_counters},
+			m_outer_peak{detail::current_alloc_counters.peak_live_bytes}
+		{
+			// The peak of an enclosing scope is restored at exit
+			detail::current_alloc_counters.peak_live_bytes = detail::current_alloc_counters.live_bytes;
+		}
+
+		~alloc_scope()
+		{
+			auto const end = detail::current_alloc_counters;
+			detail::current_alloc_counters.peak_live_bytes = std::max(m_outer_peak, end.peak_live_bytes);
+
+			atomic_write([this, &end](){
+				write_raw("<table class=\"alloc_scope\">\n<caption>");
+				write_as_html(m_name);
+				write_raw("</caption>\n");
+				print_row("Allocations", end.count - m_start.count);
+				print_row("Bytes requested", end.bytes - m_start.bytes);
+				print_row("Peak live bytes", end.peak_live_bytes - m_start.live_bytes);
+				print_row("Live bytes at exit", end.live_bytes - m_start.live_bytes);
+				write_raw("</table>\n");
+
+				if(end.count == m_start.count)
+				{ return; }
+
+				write_raw("<table class=\"alloc_scope\">\n<caption>Allocation sizes</caption>\n");
+				for(size_t k = 0; k != std::size(end.size_classes); ++k)
+				{
+					auto const count = end.size_classes[k] - m_start.size_classes[k];
+					if(count == 0)
+					{ continue; }
+
+					write_raw("<tr><td>&le; ");
+					write_as_html(size_t{1} << k);
+					write_raw(" B</td>");
+					print_table_cell(count);
+					write_raw("</tr>\n");
+				}
+				write_raw("</table>\n");
+			});
+		}
+
+		alloc_scope(alloc_scope const&) = delete;
+		alloc_scope& operator=(alloc_scope const&) = delete;
+
+	private:
+		std::string m_name;
+		detail::alloc_counters m_start;
+		int64_t m_outer_peak;
+
+		template<class T>
+		static void print_row(char const* label, T value)
+		{
+			write_raw("<tr>");
+			print_table_cell(label);
+			print_table_cell(value);
+			write_raw("</tr>\n");
+		}
+	};
+}
+
+#ifdef PRETTY_DEFINE_ALLOCATION_TRACKING_OPERATORS
+
+void* operator new(size_t size)
+{ return pretty::detail::allocate_or_throw(size, alignof(std::max_align_t)); }
+
+void* operator new[](size_t size)
+{ return pretty::detail::allocate_or_throw(size, alignof(std::max_align_t)); }
+
+void* operator new(size_t size, std::align_val_t alignment)
+{ return pretty::detail::allocate_or_throw(size, static_cast<size_t>(alignment)); }
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{ return pretty::detail::allocate_or_throw(size, static_cast<size_t>(alignment)); }
+
+void* operator new(size_t size, std::nothrow_t const&) noexcept
+{ return pretty::detail::allocate(size, alignof(std::max_align_t)); }
+
+void* operator new[](size_t size, std::nothrow_t const&) noexcept
+{ return pretty::detail::allocate(size, alignof(std::max_align_t)); }
+
+void* operator new(size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{ return pretty::detail::allocate(size, static_cast<size_t>(alignment)); }
+
+void* operator new[](size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{ return pretty::detail::allocate(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* ptr) noexcept
+{ pretty::detail::deallocate(ptr, alignof(std::max_align_t)); }
+
+void operator delete[](void* ptr) noexcept
+{ pretty::detail::deallocate(ptr, alignof(std::max_align_t)); }
+
+void operator delete(void* ptr, size_t) noexcept
+{ pretty::detail::deallocate(ptr, alignof(std::max_align_t)); }
+
+void operator delete[](void* ptr, size_t) noexcept
+{ pretty::detail::deallocate(ptr, alignof(std::max_align_t)); }
+
+void operator delete(void* ptr, std::align_val_t alignment) noexcept
+{ pretty::detail::deallocate(ptr, static_cast<size_t>(alignment)); }
+
+void operator delete[](void* ptr, std::align_val_t alignment) noexcept
+{ pretty::detail::deallocate(ptr, static_cast<size_t>(alignment)); }
+
+void operator delete(void* ptr, size_t, std::align_val_t alignment) noexcept
+{ pretty::detail::deallocate(ptr, static_cast<size_t>(alignment)); }
+
+void operator delete[](void* ptr, size_t, std::align_val_t alignment) noexcept
+{ pretty::detail::deallocate(ptr, static_cast<size_t>(alignment)); }
+
+void operator delete(void* ptr, std::nothrow_t const&) noexcept
+{ pretty::detail::deallocate(ptr, alignof(std::max_align_t)); }
+
+void operator delete[](void* ptr, std::nothrow_t const&) noexcept
+{ pretty::detail::deallocate(ptr, alignof(std::max_align_t)); }
+
+void operator delete(void* ptr, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{ pretty::detail::deallocate(ptr, static_cast<size_t>(alignment)); }
+
+void operator delete[](void* ptr, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{ pretty::detail::deallocate(ptr, static_cast<size_t>(alignment)); }
+
+#endif
+
+#endif
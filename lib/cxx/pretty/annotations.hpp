@@ -48,18 +48,27 @@ namespace pretty
 
 	struct box
 	{
-		[[nodiscard]] box()
+		[[nodiscard]] box():
+			enabled{output_enabled()}
 		{
+			if(!enabled)
+			{ return; }
+
+			lock.lock();
 			puts("<div class=\"box\">");
 		}
 
 		~box()
 		{
+			if(!enabled)
+			{ return; }
+
 			puts("</div>");
 			fflush(stdout);
 		}
 
-		std::lock_guard<std::recursive_mutex> lock{output_mutex};
+		bool enabled;
+		std::unique_lock<std::recursive_mutex> lock{output_mutex, std::defer_lock};
 	};
 	
 	template<class Caption>
@@ -67,13 +76,18 @@ namespace pretty
 	{
 	public:
 		[[nodiscard]] explicit figure(Caption caption):
-			m_caption{caption}
+			m_caption{caption},
+			m_enabled{output_enabled()}
 		{
-			write_raw("<figure>");
+			if(m_enabled)
+			{ write_raw("<figure>"); }
 		}
 		
 		~figure()
 		{
+			if(!m_enabled)
+			{ return; }
+
 			write_as_html(m_caption);
 			puts("</figure>");
 			fflush(stdout);
@@ -81,6 +95,7 @@ namespace pretty
 		
 	private:
 		Caption m_caption;
+		bool m_enabled;
 	};
 }
 #endif
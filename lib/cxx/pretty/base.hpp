@@ -8,6 +8,8 @@
 #include <mutex>
 #include <charconv>
 #include <array>
+#include <atomic>
+#include <cstdint>
 
 namespace pretty
 {
@@ -144,23 +146,91 @@ namespace pretty
 
 	inline constinit std::recursive_mutex output_mutex;
 
+	// Ranges with at least this many elements are formatted in chunks on several threads. The
+	// output is the same as when formatting on one thread. Only done on Linux.
+	inline constinit size_t parallel_format_threshold = 1 << 16;
+
+	// Number of elements in each chunk when formatting in parallel
+	inline constinit size_t parallel_format_chunk_size = 1 << 12;
+
+	// Number of threads used for formatting in parallel. Zero means one per hardware thread.
+	inline constinit size_t parallel_format_threads = 0;
+
+#ifdef PRETTY_DISABLE
+	inline constexpr bool output_compiled_in = false;
+#else
+	inline constexpr bool output_compiled_in = true;
+#endif
+
+	enum class verbosity : unsigned
+	{
+		essential,
+		normal,
+		detailed,
+		debug
+	};
+
+	using category_mask = uint64_t;
+
+	inline constexpr category_mask all_categories = ~category_mask{0};
+
+	inline verbosity current_verbosity();
+
+	inline bool output_enabled(verbosity level, category_mask categories = all_categories);
+
+	inline bool output_enabled();
+
+	inline void set_output_verbosity(verbosity level);
+
+	inline void set_output_categories(category_mask categories);
+
+	class verbosity_scope;
+
 	template<class Function, class ... Args>
 	void atomic_write(Function&& func, Args&&... args);
 
 	template<class T>
 	void print(T const& val);
 
+	template<class T>
+	void write_labeled_value(std::string_view label, T const& value);
+
 	template<class T>
 	void print_labeled_value(char const* label, T const& value);
 
 	template<class T>
 	void print_labeled_value(std::string_view label, T const& value);
 
+#ifdef PRETTY_DISABLE
+	// The arguments are kept in an unevaluated operand, so that variables which are only printed are
+	// still used
+	#define PRETTY_PRINT_EXPR(expr) static_cast<void>(sizeof((expr), 0))
+
+	#define PRETTY_IN(categories, level, ...) \
+	static_cast<void>(sizeof((categories), (level), [&](){ __VA_ARGS__; }, 0))
+#else
 	#define PRETTY_PRINT_EXPR(expr) \
-	pretty::print_labeled_value(#expr, expr)
+	(pretty::output_enabled() ? pretty::print_labeled_value(#expr, expr) : static_cast<void>(0))
+
+	// Runs the statements in __VA_ARGS__ only if output at level, in any of categories, is enabled.
+	// Arguments are not evaluated otherwise.
+	#define PRETTY_IN(categories, level, ...) \
+	do \
+	{ \
+		if(pretty::output_enabled(level, categories)) \
+		{ \
+			pretty::verbosity_scope pretty_verbosity_scope{level}; \
+			__VA_ARGS__; \
+		} \
+	} \
+	while(false)
+#endif
+
+	#define PRETTY_AT(level, ...) PRETTY_IN(pretty::all_categories, level, __VA_ARGS__)
 }
 
 #define PRETTY_BASE_IS_INCLUDED
 #include "./base_impl.hpp"
+#include "./shm_transport.hpp"
 
 #endif
@@ -3,11 +3,251 @@
 #endif
 
 #include <cstdio>
+#include <cstdlib>
 #include <algorithm>
+#include <bit>
 #include <limits>
 #include <functional>
 #include <string>
 #include <typeinfo>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+#include <new>
+#include <exception>
+
+namespace pretty::detail
+{
+	// Where the current thread writes formatted output. Null means stdout.
+	inline constinit thread_local FILE* output_file = nullptr;
+
+	inline FILE* output()
+	{ return output_file != nullptr ? output_file : stdout; }
+
+	// A thread owns its output_file, so there is no need to lock it. The unlocked functions are
+	// only used where glibc provides them.
+#ifdef __GLIBC__
+	inline void put_unlocked(char ch, FILE* file)
+	{ putc_unlocked(ch, file); }
+
+	inline void put_unlocked(char const* str, FILE* file)
+	{ fputs_unlocked(str, file); }
+
+	inline void put_unlocked(void const* buffer, size_t size, FILE* file)
+	{ fwrite_unlocked(buffer, 1, size, file); }
+#else
+	inline void put_unlocked(char ch, FILE* file)
+	{ putc(ch, file); }
+
+	inline void put_unlocked(char const* str, FILE* file)
+	{ fputs(str, file); }
+
+	inline void put_unlocked(void const* buffer, size_t size, FILE* file)
+	{ fwrite(buffer, 1, size, file); }
+#endif
+
+	inline void write_char(char ch)
+	{
+		if(output_file != nullptr)
+		{ put_unlocked(ch, output_file); }
+		else
+		{ putchar(ch); }
+	}
+
+	inline void write_line(char const* str)
+	{
+		if(output_file != nullptr)
+		{
+			put_unlocked(str, output_file);
+			put_unlocked('\n', output_file);
+		}
+		else
+		{ puts(str); }
+	}
+
+	inline void write_bytes(void const* buffer, size_t size)
+	{
+		if(output_file != nullptr)
+		{ put_unlocked(buffer, size, output_file); }
+		else
+		{ fwrite(buffer, 1, size, stdout); }
+	}
+
+	// True if T is formatted by the library only. Other types may be formatted by user code that
+	// writes directly to stdout.
+	template<class T>
+	constexpr bool is_library_formatted();
+
+	template<class T, size_t ... I>
+	constexpr bool elements_are_library_formatted(std::index_sequence<I...>)
+	{ return (is_library_formatted<tuple_element_t<T, I>>() && ...); }
+
+	template<class T>
+	constexpr bool is_library_formatted()
+	{
+		if constexpr(std::is_arithmetic_v<T> || std::is_pointer_v<T> || std::is_same_v<T, std::byte>
+			|| std::is_convertible_v<T const&, std::string_view>)
+		{ return true; }
+		else
+		if constexpr(std::ranges::forward_range<T>)
+		{ return is_library_formatted<std::ranges::range_value_t<T>>(); }
+		else
+		if constexpr(tuple<T>)
+		{ return elements_are_library_formatted<T>(std::make_index_sequence<std::tuple_size_v<T>>{}); }
+		else
+		{ return false; }
+	}
+
+	// The record format replaces the markup of lists and tables with one-byte tokens, and sends
+	// numbers in binary. A frame starts with record_marker and the format version, and ends with
+	// record_token::end. Anything outside a frame is plain HTML. Must match server/records.py.
+	inline constexpr std::string_view record_marker{"\x1ePR"};
+
+	inline constexpr uint8_t record_format_version = 1;
+
+	enum class record_token : uint8_t
+	{
+		end,
+		signed_int,
+		unsigned_int,
+		float32,
+		float64,
+		text,
+		html,
+		byte,
+		pointer,
+		point,
+		markup = 0x40
+	};
+
+	enum class markup : uint8_t
+	{
+		tuple_list,
+		range_list,
+		nested_range_list,
+		list_end,
+		tuple_table,
+		range_table,
+		tuple_range_table,
+		single_row_table,
+		table_end,
+		row,
+		row_end,
+		item,
+		item_end,
+		cell,
+		cell_end,
+		empty
+	};
+
+	inline constexpr std::array<char const*, 16> markup_text{
+		"<ol start=\"0\" class=\"tuple_content\">\n",
+		"<ol start=\"0\" class=\"range_content\">\n",
+		"<ol class=\"range_content\" start=\"0\">\n",
+		"</ol>\n",
+		"<table class=\"tuple_content\">\n",
+		"<table class=\"range_content\">\n",
+		"<table>\n",
+		"<table class=\"single_row\">\n",
+		"</table>\n",
+		"<tr>\n",
+		"</tr>\n",
+		"<li>",
+		"</li>",
+		"<td>",
+		"</td>",
+		"<span class=\"empty\">(no value)</span>\n"
+	};
+
+	inline bool const records_enabled = [](){
+		auto const val = getenv("PRETTY_OUTPUT_FORMAT");
+		return val != nullptr && std::string_view{val} == "records";
+	}();
+
+	// True while the current thread writes a record frame
+	inline constinit thread_local bool recording = false;
+
+	// Number of atomic_write calls the current thread is in. Only the thread that holds
+	// output_mutex can be in one. Allocations made while writing output are not counted by
+	// alloc_tracking.hpp.
+	inline constinit thread_local size_t atomic_write_depth = 0;
+
+	inline void write_token(record_token token)
+	{ write_char(static_cast<char>(token)); }
+
+	inline void write_varint(uint64_t val)
+	{
+		while(val >= 0x80)
+		{
+			write_char(static_cast<char>((val & 0x7f) | 0x80));
+			val >>= 7;
+		}
+		write_char(static_cast<char>(val));
+	}
+
+	inline void write_record_text(record_token token, std::string_view str)
+	{
+		write_token(token);
+		write_varint(std::size(str));
+		write_bytes(std::data(str), std::size(str));
+	}
+
+	// std::fpclassify cannot be relied on with -ffast-math, so look at the bits
+	template<class T>
+	bool is_subnormal(T val)
+	{
+		using bits_type = std::conditional_t<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>;
+		auto const magnitude = std::bit_cast<bits_type>(val) & ~(bits_type{1} << (8*sizeof(T) - 1));
+		return magnitude != 0 && magnitude < (bits_type{1} << (std::numeric_limits<T>::digits - 1));
+	}
+
+	inline void write_markup(markup item)
+	{
+		if(recording)
+		{ write_char(static_cast<char>(static_cast<uint8_t>(record_token::markup) + static_cast<uint8_t>(item))); }
+		else
+		{
+			auto const str = markup_text[static_cast<size_t>(item)];
+			if(output_file != nullptr)
+			{ put_unlocked(str, output_file); }
+			else
+			{ fputs(str, stdout); }
+		}
+	}
+
+	// Starts a record frame if records are enabled, and no frame is open already. Only use it for
+	// content that is formatted by the library.
+	class record_frame
+	{
+	public:
+		explicit record_frame(bool eligible):
+			m_outermost{eligible && records_enabled && !recording}
+		{
+			if(!m_outermost)
+			{ return; }
+
+			write_bytes(std::data(record_marker), std::size(record_marker));
+			write_char(static_cast<char>(record_format_version));
+			recording = true;
+		}
+
+		~record_frame()
+		{
+			if(!m_outermost)
+			{ return; }
+
+			recording = false;
+			write_token(record_token::end);
+		}
+
+		record_frame(record_frame const&) = delete;
+		record_frame& operator=(record_frame const&) = delete;
+
+	private:
+		bool m_outermost;
+	};
+}
 
 
 template<class T>
@@ -67,38 +307,63 @@ constexpr bool pretty::elements_have_same_size(T const& t)
 
 void pretty::write_as_html(char ch)
 {
+	if(detail::recording)
+	{
+		detail::write_record_text(detail::record_token::text, std::string_view{&ch, 1});
+		return;
+	}
+
 	switch(ch)
 	{
 	case '&':
-		printf("&");
+		fprintf(detail::output(), "&");
 		break;
 	case '<':
-		printf("<");
+		fprintf(detail::output(), "<");
 		break;
 	case '>':
-		printf(">");
+		fprintf(detail::output(), ">");
 		break;
 	case '"':
-		printf("&quot;");
+		fprintf(detail::output(), "&quot;");
 		break;
 
 	default:
-		putchar(ch);
+		detail::write_char(ch);
 	}
 }
 
 void pretty::write_as_html(std::byte val)
 {
-	printf("<code class=\"byte\">%02x</code>", static_cast<uint8_t>(val));
+	if(detail::recording)
+	{
+		detail::write_token(detail::record_token::byte);
+		detail::write_char(static_cast<char>(val));
+		return;
+	}
+
+	fprintf(detail::output(), "<code class=\"byte\">%02x</code>", static_cast<uint8_t>(val));
 }
 
 void pretty::write_raw(std::string_view str)
 {
-	std::ranges::for_each(str, [](auto item){putchar(item);});
+	if(detail::recording)
+	{
+		detail::write_record_text(detail::record_token::html, str);
+		return;
+	}
+
+	std::ranges::for_each(str, [](auto item){detail::write_char(item);});
 }
 
 void pretty::write_as_html(std::string_view str)
 {
+	if(detail::recording)
+	{
+		detail::write_record_text(detail::record_token::text, str);
+		return;
+	}
+
 	std::ranges::for_each(str, [](auto x) { write_as_html(x); });
 }
 
@@ -115,12 +380,50 @@ void pretty::write_as_html(char const* c_str)
 template<std::integral T>
 void pretty::write_as_html(T val)
 {
+	if constexpr(sizeof(T) <= sizeof(uint64_t))
+	{
+		if(detail::recording)
+		{
+			if constexpr(std::is_signed_v<T>)
+			{
+				auto const x = static_cast<int64_t>(val);
+				detail::write_token(detail::record_token::signed_int);
+				detail::write_varint((static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63));
+			}
+			else
+			{
+				detail::write_token(detail::record_token::unsigned_int);
+				detail::write_varint(static_cast<uint64_t>(val));
+			}
+			return;
+		}
+	}
+
 	write_as_html(std::data(to_char_buffer(val)));
 }
 
 template<std::floating_point T>
 void pretty::write_as_html(T val)
 {
+	if constexpr(std::is_same_v<T, float> || std::is_same_v<T, double>)
+	{
+		if(detail::recording)
+		{
+			// How subnormals are formatted depends on the floating point environment. For example,
+			// they show as 0 with -ffast-math. Send them as text, formatted like in HTML output.
+			if(detail::is_subnormal(val))
+			{
+				detail::write_record_text(detail::record_token::text, std::data(to_char_buffer(val)));
+				return;
+			}
+
+			detail::write_token(std::is_same_v<T, float> ? detail::record_token::float32
+				: detail::record_token::float64);
+			detail::write_bytes(&val, sizeof(val));
+			return;
+		}
+	}
+
 	write_as_html(std::data(to_char_buffer(val)));
 }
 
@@ -130,13 +433,20 @@ void pretty::write_as_html(std::optional<T> const& x)
 	if(x.has_value())
 	{ write_as_html(*x); }
 	else
-	{ puts("<span class=\"empty\">(no value)</span>"); }
+	{ detail::write_markup(detail::markup::empty); }
 }
 
 template<class T>
 void pretty::write_as_html(T const* ptr)
 {
-	printf("<code class=\"pointer\">%p</code>", ptr);
+	if(detail::recording)
+	{
+		detail::write_token(detail::record_token::pointer);
+		detail::write_varint(reinterpret_cast<uintptr_t>(ptr));
+		return;
+	}
+
+	fprintf(detail::output(), "<code class=\"pointer\">%p</code>", ptr);
 }
 
 template<class ... T>
@@ -149,90 +459,273 @@ template<class T>
 requires(pretty::tuple<T> && !std::ranges::range<T>)
 void pretty::write_as_html(T const& x)
 {
+	detail::record_frame frame{detail::is_library_formatted<T>()};
 	if constexpr(elements_have_table_row_formatter<T>())
 	{
 		if(elements_have_same_size(x))
 		{
-			puts("<table class=\"tuple_content\">");
+			detail::write_markup(detail::markup::tuple_table);
 			apply_adl([](auto const& ... args){
 				(print_table_row(args), ...);
 			}, x);
-			puts("</table>");
+			detail::write_markup(detail::markup::table_end);
 		}
 		else
 		{
-			puts("<ol start=\"0\" class=\"tuple_content\">");
+			detail::write_markup(detail::markup::tuple_list);
 			apply_adl([](auto const&... args){
 				(print_list_item(args),...);
 			}, x);
-			puts("</ol>");
+			detail::write_markup(detail::markup::list_end);
 		}
 	}
 	else
 	{
-		puts("<ol start=\"0\" class=\"tuple_content\">");
+		detail::write_markup(detail::markup::tuple_list);
 		apply_adl([](auto const&... args){
 			(print_list_item(args),...);
 		}, x);
-		puts("</ol>");
+		detail::write_markup(detail::markup::list_end);
 	}
 }
 
 template<class T>
 void pretty::print_list_item(T const& val)
 {
-	write_raw("<li>");
+	detail::write_markup(detail::markup::item);
 	write_as_html(val);
-	write_raw("</li>");
+	detail::write_markup(detail::markup::item_end);
 }
 
 template<class T>
 void pretty::print_table_cell(T const& val)
 {
-	write_raw("<td>");
+	detail::write_markup(detail::markup::cell);
 	write_as_html(val);
-	write_raw("</td>");
+	detail::write_markup(detail::markup::cell_end);
 }
 
 template<std::ranges::forward_range R>
 void pretty::print_table_row(R const& range)
 {
-	puts("<tr>");
+	detail::record_frame frame{detail::is_library_formatted<R>()};
+	detail::write_markup(detail::markup::row);
 	std::ranges::for_each(range, [](auto const& item) {
 		print_table_cell(item);
 	});
-	puts("</tr>");
+	detail::write_markup(detail::markup::row_end);
 }
 
 template<pretty::tuple T>
 requires(!std::ranges::forward_range<T>)
 void pretty::print_table_row(T const& item)
 {
-	puts("<tr>");
+	detail::record_frame frame{detail::is_library_formatted<T>()};
+	detail::write_markup(detail::markup::row);
 	apply_adl([](auto const&... args){
 		(print_table_cell(args),...);
 	}, item);
-	puts("</tr>");
+	detail::write_markup(detail::markup::row_end);
+}
+
+namespace pretty::detail
+{
+	// Chunks are formatted into memory streams from open_memstream. Like shm_transport.hpp, this
+	// is only used on Linux. Elsewhere, ranges are formatted on the calling thread.
+#ifdef __linux__
+	struct free_deleter
+	{
+		void operator()(char* ptr) const
+		{ free(ptr); }
+	};
+
+	struct formatted_chunk
+	{
+		std::unique_ptr<char, free_deleter> buffer;
+		size_t size = 0;
+		bool ready = false;
+	};
+
+	inline size_t parallel_format_thread_count()
+	{
+		return parallel_format_threads != 0 ? parallel_format_threads
+			: std::max(static_cast<size_t>(std::thread::hardware_concurrency()), size_t{1});
+	}
+
+	// Formats the elements of range in chunks, on parallel_format_threads threads. Chunks are
+	// written to the output in order, as soon as they are ready.
+	template<class R, class Function>
+	void format_in_parallel(R const& range, Function const& func)
+	{
+		auto const size = std::ranges::size(range);
+		auto const chunk_size = std::max(parallel_format_chunk_size, size_t{1});
+		auto const chunk_count = (size + chunk_size - 1)/chunk_size;
+		auto const thread_count = std::min(chunk_count, parallel_format_thread_count());
+		// Limits how far the workers may run ahead of the output, so memory use stays bounded
+		auto const max_chunks_in_flight = 2*thread_count;
+
+		std::vector<formatted_chunk> chunks(chunk_count);
+		std::mutex chunks_mutex;
+		std::condition_variable chunks_cv;
+		size_t next_chunk = 0;
+		size_t chunks_written = 0;
+		// The first exception thrown by a worker. It is rethrown on the calling thread.
+		std::exception_ptr error;
+
+		// A chunk is part of the frame that the calling thread has opened, if any, and of its
+		// atomic_write
+		auto const format_chunks = [&, parent_recording = recording, parent_depth = atomic_write_depth]() {
+			recording = parent_recording;
+			atomic_write_depth = parent_depth;
+			while(true)
+			{
+				size_t k;
+				{
+					std::unique_lock lock{chunks_mutex};
+					chunks_cv.wait(lock, [&]() {
+						return next_chunk == chunk_count || next_chunk < chunks_written + max_chunks_in_flight;
+					});
+					if(next_chunk == chunk_count)
+					{ return; }
+					k = next_chunk++;
+				}
+
+				formatted_chunk chunk{};
+				// Owned by the stream until it is closed
+				char* buffer = nullptr;
+				try
+				{
+					output_file = open_memstream(&buffer, &chunk.size);
+					if(output_file == nullptr)
+					{ throw std::bad_alloc{}; }
+
+					using difference_type = std::ranges::range_difference_t<R>;
+					auto const first = std::ranges::begin(range) + static_cast<difference_type>(k*chunk_size);
+					std::for_each(first, first + static_cast<difference_type>(std::min(chunk_size, size - k*chunk_size)),
+						func);
+					auto const stream = output_file;
+					output_file = nullptr;
+					auto const write_failed = ferror(stream) != 0;
+					auto const close_failed = fclose(stream) != 0;
+					chunk.buffer.reset(buffer);
+					if(close_failed || write_failed)
+					{ throw std::bad_alloc{}; }
+					chunk.ready = true;
+				}
+				catch(...)
+				{
+					if(output_file != nullptr)
+					{
+						fclose(output_file);
+						output_file = nullptr;
+						chunk.buffer.reset(buffer);
+					}
+
+					// Stop the other workers, and wake the calling thread
+					{
+						std::lock_guard lock{chunks_mutex};
+						if(error == nullptr)
+						{ error = std::current_exception(); }
+						next_chunk = chunk_count;
+					}
+					chunks_cv.notify_all();
+					return;
+				}
+
+				{
+					std::lock_guard lock{chunks_mutex};
+					chunks[k] = std::move(chunk);
+				}
+				chunks_cv.notify_all();
+			}
+		};
+
+		std::vector<std::jthread> workers;
+		workers.reserve(thread_count);
+		try
+		{
+			for(size_t k = 0; k != thread_count; ++k)
+			{ workers.emplace_back(format_chunks); }
+		}
+		catch(...)
+		{
+			// A thread could not be started. Stop the ones that were, so they can be joined.
+			{
+				std::lock_guard lock{chunks_mutex};
+				next_chunk = chunk_count;
+			}
+			chunks_cv.notify_all();
+			workers.clear();
+			throw;
+		}
+
+		auto const dest = output();
+		for(size_t k = 0; k != chunk_count; ++k)
+		{
+			formatted_chunk chunk;
+			{
+				std::unique_lock lock{chunks_mutex};
+				chunks_cv.wait(lock, [&chunks, &error, k](){ return chunks[k].ready || error != nullptr; });
+				if(error != nullptr)
+				{ break; }
+				chunk = std::move(chunks[k]);
+			}
+			fwrite(chunk.buffer.get(), 1, chunk.size, dest);
+			{
+				std::lock_guard lock{chunks_mutex};
+				++chunks_written;
+			}
+			chunks_cv.notify_all();
+		}
+
+		// No worker touches error once they have all returned
+		workers.clear();
+		if(error != nullptr)
+		{ std::rethrow_exception(error); }
+	}
+#endif
+
+	template<class R, class Function>
+	void for_each_formatted(R const& range, Function const& func)
+	{
+#ifdef __linux__
+		if constexpr(std::ranges::random_access_range<R const> && std::ranges::sized_range<R const>
+			&& is_library_formatted<std::ranges::range_value_t<R>>())
+		{
+			// Formatting threads write to their own buffers, so do not start more threads from them
+			if(std::ranges::size(range) >= parallel_format_threshold && output_file == nullptr
+				&& parallel_format_thread_count() > 1)
+			{
+				format_in_parallel(range, func);
+				return;
+			}
+		}
+#endif
+
+		std::ranges::for_each(range, func);
+	}
 }
 
 template<std::ranges::forward_range R>
 void pretty::write_as_html(R const& range)
 {
-	puts("<ol start=\"0\" class=\"range_content\">");
-	std::ranges::for_each(range, [](auto const& item){ print_list_item(item); });
-	puts("</ol>");
+	detail::record_frame frame{detail::is_library_formatted<R>()};
+	detail::write_markup(detail::markup::range_list);
+	detail::for_each_formatted(range, [](auto const& item){ print_list_item(item); });
+	detail::write_markup(detail::markup::list_end);
 }
 
 template<pretty::fwd_range_of_sized_range R>
 void pretty::write_as_html(R const& range)
 {
+	detail::record_frame frame{detail::is_library_formatted<R>()};
 	if constexpr(fwd_range_of_constexpr_sized_range<R>)
 	{
-		puts("<table class=\"range_content\">");
-		std::ranges::for_each(range, [](auto const& range){
+		detail::write_markup(detail::markup::range_table);
+		detail::for_each_formatted(range, [](auto const& range){
 			print_table_row(range);
 		});
-		puts("</table>");
+		detail::write_markup(detail::markup::table_end);
 	}
 	else
 	{
@@ -244,20 +737,20 @@ void pretty::write_as_html(R const& range)
 		{
 			if(i == std::end(range))
 			{
-				puts("<table class=\"range_content\">");
-				std::ranges::for_each(range, [](auto const& range){
+				detail::write_markup(detail::markup::range_table);
+				detail::for_each_formatted(range, [](auto const& range){
 					print_table_row(range);
 				});
-				puts("</table>");
+				detail::write_markup(detail::markup::table_end);
 			}
 		}
 		else
 		{
-			puts("<ol class=\"range_content\" start=\"0\">");
-			std::ranges::for_each(range, [](auto const& range) {
+			detail::write_markup(detail::markup::nested_range_list);
+			detail::for_each_formatted(range, [](auto const& range) {
 				print_list_item(range);
 			});
-			puts("</ol>");
+			detail::write_markup(detail::markup::list_end);
 		}
 	}
 }
@@ -266,11 +759,12 @@ template<class R>
 requires(pretty::fwd_range_of_tuple<R> && !pretty::fwd_range_of_sized_range<R>)
 void pretty::write_as_html(R const& range)
 {
-	puts("<table>");
-	std::ranges::for_each(range, [](auto const& item){
+	detail::record_frame frame{detail::is_library_formatted<R>()};
+	detail::write_markup(detail::markup::tuple_range_table);
+	detail::for_each_formatted(range, [](auto const& item){
 		print_table_row(item);
 	});
-	puts("</table>");
+	detail::write_markup(detail::markup::table_end);
 }
 
 namespace pretty::detail
@@ -290,11 +784,121 @@ constexpr decltype(auto) pretty::apply_adl(F&& f, Tuple&& t)
 		std::make_index_sequence<std::tuple_size_v<std::remove_reference_t<Tuple>>>{});
 }
 
+namespace pretty::detail
+{
+	inline verbosity verbosity_from_env()
+	{
+		auto const val = getenv("PRETTY_VERBOSITY");
+		if(val == nullptr)
+		{ return verbosity::normal; }
+
+		std::string_view const str{val};
+		if(str == "essential" || str == "0")
+		{ return verbosity::essential; }
+		if(str == "detailed" || str == "2")
+		{ return verbosity::detailed; }
+		if(str == "debug" || str == "3")
+		{ return verbosity::debug; }
+		return verbosity::normal;
+	}
+
+	inline std::atomic<verbosity> output_verbosity{verbosity_from_env()};
+
+	inline constinit std::atomic<category_mask> output_categories{all_categories};
+
+	// The level of output produced by the current thread
+	inline constinit thread_local verbosity current_verbosity = verbosity::normal;
+}
+
+pretty::verbosity pretty::current_verbosity()
+{
+	return detail::current_verbosity;
+}
+
+bool pretty::output_enabled(verbosity level, category_mask categories)
+{
+	return output_compiled_in
+		&& level <= detail::output_verbosity.load(std::memory_order_relaxed)
+		&& (categories & detail::output_categories.load(std::memory_order_relaxed)) != 0;
+}
+
+bool pretty::output_enabled()
+{
+	return output_enabled(detail::current_verbosity);
+}
+
+void pretty::set_output_verbosity(verbosity level)
+{
+	detail::output_verbosity.store(level, std::memory_order_relaxed);
+}
+
+void pretty::set_output_categories(category_mask categories)
+{
+	detail::output_categories.store(categories, std::memory_order_relaxed);
+}
+
+class pretty::verbosity_scope
+{
+public:
+	explicit verbosity_scope(verbosity level):
+		m_prev_level{detail::current_verbosity}
+	{ detail::current_verbosity = level; }
+
+	~verbosity_scope()
+	{ detail::current_verbosity = m_prev_level; }
+
+	verbosity_scope(verbosity_scope const&) = delete;
+	verbosity_scope& operator=(verbosity_scope const&) = delete;
+
+private:
+	verbosity m_prev_level;
+};
+
+namespace pretty::detail
+{
+	// Must match the markers in server/output_store.py
+	inline constexpr std::string_view fragment_begin_marker{"<!--pretty:fragment-->"};
+	inline constexpr std::string_view fragment_end_marker{"<!--/pretty:fragment-->"};
+
+	// Only set when running under the server, which uses the markers to split the output
+	inline bool const emit_fragment_markers = getenv("PRETTY_FRAGMENT_MARKERS") != nullptr;
+
+	class fragment
+	{
+	public:
+		fragment():m_outermost{atomic_write_depth++ == 0 && emit_fragment_markers}
+		{
+			if(m_outermost)
+			{ write_raw(fragment_begin_marker); }
+		}
+
+		~fragment()
+		{
+			--atomic_write_depth;
+			if(m_outermost)
+			{ write_raw(fragment_end_marker); }
+		}
+
+		fragment(fragment const&) = delete;
+		fragment& operator=(fragment const&) = delete;
+
+	private:
+		bool m_outermost;
+	};
+}
+
 template<class Function, class ... Args>
 void pretty::atomic_write(Function&& func, Args&& ... args)
 {
+	// Checked before taking the lock, so disabled output is cheap
+	if(!output_enabled())
+	{ return; }
+
 	std::lock_guard g{output_mutex};
-	func(std::forward<Args>(args)...);
+	{
+		detail::fragment current_fragment{};
+		func(std::forward<Args>(args)...);
+	}
 	fflush(stdout);
 }
 
@@ -306,13 +910,20 @@ void pretty::print(T const& val)
 	}, val);
 }
 
+template<class T>
+void pretty::write_labeled_value(std::string_view label, T const& value)
+{
+	detail::record_frame frame{detail::is_library_formatted<T>()};
+	detail::write_markup(detail::markup::single_row_table);
+	print_table_row(std::tuple{label, "=", value});
+	detail::write_markup(detail::markup::table_end);
+}
+
 template<class T>
 void pretty::print_labeled_value(std::string_view label, T const& value)
 {
 	atomic_write([](std::string_view label, auto const& value) {
-		puts("<table class=\"single_row\">");
-		print_table_row(std::tuple{label, "=", value});
-		puts("</table>");
+		write_labeled_value(label, value);
 	}, label, value);
 }
 
@@ -0,0 +1,444 @@
+#ifndef PRETTY_DIFF_HPP
+#define PRETTY_DIFF_HPP
+
+#include "./base.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace pretty
+{
+	template<class T>
+	struct is_bytewise_hashable : std::bool_constant<std::has_unique_object_representations_v<T>
+		|| std::is_floating_point_v<T>>
+	{};
+
+	template<class T, size_t N>
+	struct is_bytewise_hashable<std::array<T, N>> : is_bytewise_hashable<T>
+	{};
+
+	template<class T>
+	concept bytewise_hashable = is_bytewise_hashable<T>::value;
+
+	// The finalizer of splitmix64
+	inline uint64_t scramble_hash(uint64_t x)
+	{
+		x += 0x9e3779b97f4a7c15ull;
+		x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+	inline uint64_t mix_hash(uint64_t a, uint64_t b)
+	{ return scramble_hash(a ^ scramble_hash(b)); }
+
+	inline uint64_t hash_bytes(void const* data, size_t n, uint64_t seed = 0)
+	{
+		auto ptr = static_cast<std::byte const*>(data);
+		auto ret = mix_hash(seed, n);
+		while(n >= 8)
+		{
+			uint64_t word;
+			memcpy(&word, ptr, 8);
+			ret = mix_hash(ret, word);
+			ptr += 8;
+			n -= 8;
+		}
+
+		uint64_t word = 0;
+		memcpy(&word, ptr, n);
+		return mix_hash(ret, word);
+	}
+
+	template<class T>
+	uint64_t hash_value(T const& val);
+
+	template<class T>
+	uint64_t hash_value(std::optional<T> const& val);
+
+	template<class ... T>
+	uint64_t hash_value(std::variant<T...> const& val);
+
+	namespace detail
+	{
+		template<class T>
+		concept string_like = std::is_convertible_v<T const&, std::string_view>;
+
+		template<class T>
+		concept contiguous_bytewise_range = std::ranges::contiguous_range<T>
+			&& std::ranges::sized_range<T>
+			&& bytewise_hashable<std::ranges::range_value_t<T>>;
+	}
+
+	template<class T>
+	uint64_t hash_value(T const& val)
+	{
+		if constexpr(detail::string_like<T>)
+		{
+			std::string_view const str{val};
+			return hash_bytes(std::data(str), std::size(str));
+		}
+		else
+		if constexpr(bytewise_hashable<T>)
+		{ return hash_bytes(&val, sizeof(val)); }
+		else
+		if constexpr(detail::contiguous_bytewise_range<T>)
+		{
+			// Cheap path for contiguous arithmetic data
+			return hash_bytes(std::ranges::data(val),
+				std::ranges::size(val)*sizeof(std::ranges::range_value_t<T>));
+		}
+		else
+		if constexpr(std::ranges::forward_range<T>)
+		{
+			uint64_t ret = 0;
+			std::ranges::for_each(val, [&ret](auto const& item) {
+				ret = mix_hash(ret, hash_value(item));
+			});
+			return ret;
+		}
+		else
+		if constexpr(tuple<T>)
+		{
+			return apply_adl([](auto const& ... items) {
+				uint64_t ret = 0;
+				((ret = mix_hash(ret, hash_value(items))), ...);
+				return ret;
+			}, val);
+		}
+		else
+		{
+			static_assert(sizeof(T) == 0, "There is no way to hash this type");
+			return 0;
+		}
+	}
+
+	template<class T>
+	uint64_t hash_value(std::optional<T> const& val)
+	{ return val.has_value() ? mix_hash(1, hash_value(*val)) : 0; }
+
+	template<class ... T>
+	uint64_t hash_value(std::variant<T...> const& val)
+	{
+		return mix_hash(val.index(), std::visit([](auto const& item){ return hash_value(item); }, val));
+	}
+
+	struct print_diff_options
+	{
+		// Print unchanged rows too, and only highlight the difference
+		bool show_all = false;
+	};
+
+	// Snapshots of all keys together are kept below this size. The least recently used snapshots
+	// are dropped first.
+	inline constinit size_t print_diff_snapshot_limit = 64 << 20;
+
+	namespace detail
+	{
+		template<class T>
+		concept associative_container = std::ranges::forward_range<T> && requires
+		{
+			typename T::key_type;
+		};
+
+		template<class T>
+		concept map_like = associative_container<T> && requires
+		{
+			typename T::mapped_type;
+		};
+
+		struct diff_snapshot
+		{
+			std::vector<uint64_t> row_hashes;
+			// Number of entries with a given key, and with a given key and value. Multimaps and
+			// multisets may hold several of each.
+			std::unordered_map<uint64_t, size_t> key_counts;
+			std::unordered_map<uint64_t, size_t> entry_counts;
+			size_t last_use;
+
+			size_t size_in_bytes() const
+			{
+				return sizeof(uint64_t)*std::size(row_hashes)
+					+ 4*sizeof(uint64_t)*(std::size(key_counts) + std::size(entry_counts));
+			}
+		};
+
+		using diff_snapshot_map = std::map<std::string, diff_snapshot, std::less<>>;
+
+		// Protected by output_mutex
+		inline diff_snapshot_map diff_snapshots;
+		// Snapshots ordered by last_use, least recently used first
+		inline std::map<size_t, diff_snapshot_map::iterator> diff_snapshots_by_use;
+		inline constinit size_t diff_snapshots_size = 0;
+		inline constinit size_t diff_use_count = 0;
+
+		inline void trim_diff_snapshots()
+		{
+			// The snapshot that was just stored is the most recently used, and is always kept
+			while(diff_snapshots_size > print_diff_snapshot_limit && std::size(diff_snapshots) > 1)
+			{
+				auto const oldest = std::begin(diff_snapshots_by_use);
+				diff_snapshots_size -= oldest->second->second.size_in_bytes();
+				diff_snapshots.erase(oldest->second);
+				diff_snapshots_by_use.erase(oldest);
+			}
+		}
+
+		template<class T>
+		void print_diff_cells(T const& item)
+		{
+			if constexpr(string_like<T>)
+			{ print_table_cell(item); }
+			else
+			if constexpr(std::ranges::forward_range<T>)
+			{ std::ranges::for_each(item, [](auto const& cell){ print_table_cell(cell); }); }
+			else
+			if constexpr(tuple<T>)
+			{ apply_adl([](auto const& ... cells){ (print_table_cell(cells), ...); }, item); }
+			else
+			{ print_table_cell(item); }
+		}
+
+		template<class R, class T>
+		uint64_t key_hash(T const& item)
+		{
+			if constexpr(map_like<R>)
+			{ return hash_value(get<0>(item)); }
+			else
+			{ return hash_value(item); }
+		}
+
+		template<class R, class T>
+		uint64_t mapped_hash(T const& item)
+		{
+			if constexpr(map_like<R>)
+			{ return hash_value(get<1>(item)); }
+			else
+			{ return 0; }
+		}
+
+		inline void print_diff_row_begin(char const* row_class)
+		{
+			if(row_class == nullptr)
+			{ write_raw("<tr>"); }
+			else
+			{
+				write_raw("<tr class=\"");
+				write_raw(row_class);
+				write_raw("\">");
+			}
+		}
+
+		struct diff_counts
+		{
+			size_t changed = 0;
+			size_t inserted = 0;
+			size_t removed = 0;
+		};
+
+		inline void print_diff_summary(std::string_view key, diff_counts const& counts, size_t size)
+		{
+			write_raw("<caption>");
+			write_as_html(key);
+			write_raw(": ");
+			write_as_html(counts.changed);
+			write_raw(" changed, ");
+			write_as_html(counts.inserted);
+			write_raw(" inserted, ");
+			write_as_html(counts.removed);
+			write_raw(" removed, ");
+			write_as_html(size);
+			write_raw(" in total</caption>\n");
+		}
+
+		template<class R>
+		diff_snapshot print_sequence_diff(std::string_view key, R const& range,
+			diff_snapshot const* prev, print_diff_options const& options)
+		{
+			diff_snapshot ret{};
+			ret.row_hashes.reserve(std::ranges::size(range));
+			std::ranges::for_each(range, [&ret](auto const& item) {
+				ret.row_hashes.push_back(hash_value(item));
+			});
+
+			auto const& hashes = ret.row_hashes;
+			auto const prev_size = prev != nullptr ? std::size(prev->row_hashes) : 0;
+			diff_counts counts{};
+			for(size_t k = 0; k != std::size(hashes); ++k)
+			{
+				if(k >= prev_size)
+				{ ++counts.inserted; }
+				else
+				if(hashes[k] != prev->row_hashes[k])
+				{ ++counts.changed; }
+			}
+			counts.removed = prev_size > std::size(hashes) ? prev_size - std::size(hashes) : 0;
+
+			puts("<table class=\"diff\">");
+			print_diff_summary(key, counts, std::size(hashes));
+			size_t k = 0;
+			std::ranges::for_each(range, [&k, &hashes, prev, prev_size, &options](auto const& item) {
+				char const* row_class = k >= prev_size ? "inserted"
+					: hashes[k] != prev->row_hashes[k] ? "changed"
+					: nullptr;
+
+				// Everything is new on the first call, so there is nothing to highlight
+				if(prev == nullptr)
+				{ row_class = nullptr; }
+
+				if(prev == nullptr || row_class != nullptr || options.show_all)
+				{
+					print_diff_row_begin(row_class);
+					print_table_cell(k);
+					print_diff_cells(item);
+					puts("</tr>");
+				}
+				++k;
+			});
+
+			if(counts.removed != 0)
+			{
+				write_raw("<tr class=\"removed\"><td>");
+				write_as_html(std::size(hashes));
+				write_raw("&hellip;");
+				write_as_html(prev_size - 1);
+				puts("</td><td>(removed)</td></tr>");
+			}
+			puts("</table>");
+			return ret;
+		}
+
+		template<class R>
+		diff_snapshot print_associative_diff(std::string_view key, R const& range,
+			diff_snapshot const* prev, print_diff_options const& options)
+		{
+			diff_snapshot ret{};
+			auto const size = std::ranges::size(range);
+			ret.key_counts.reserve(size);
+			ret.entry_counts.reserve(size);
+			std::vector<uint64_t> key_hashes;
+			key_hashes.reserve(size);
+			std::vector<char const*> row_classes;
+			row_classes.reserve(size);
+
+			// Entries of the previous snapshot that no current entry has been matched with. Equal
+			// entries are matched first, so that a changed duplicate does not take the place of an
+			// unchanged one.
+			auto prev_keys = prev != nullptr ? prev->key_counts : decltype(ret.key_counts){};
+			auto prev_entries = prev != nullptr ? prev->entry_counts : decltype(ret.entry_counts){};
+			std::ranges::for_each(range, [&](auto const& item) {
+				auto const current_key_hash = key_hash<R>(item);
+				auto const entry_hash = mix_hash(current_key_hash, mapped_hash<R>(item));
+				++ret.key_counts[current_key_hash];
+				++ret.entry_counts[entry_hash];
+				key_hashes.push_back(current_key_hash);
+
+				auto const i = prev_entries.find(entry_hash);
+				if(prev == nullptr || (i != std::end(prev_entries) && i->second != 0))
+				{
+					if(prev != nullptr)
+					{
+						--i->second;
+						--prev_keys[current_key_hash];
+					}
+					row_classes.push_back(nullptr);
+				}
+				else
+				{ row_classes.push_back("inserted"); }
+			});
+
+			diff_counts counts{};
+			if(prev != nullptr)
+			{
+				for(size_t k = 0; k != std::size(row_classes); ++k)
+				{
+					if(row_classes[k] == nullptr)
+					{ continue; }
+
+					auto const i = prev_keys.find(key_hashes[k]);
+					if(i != std::end(prev_keys) && i->second != 0)
+					{
+						--i->second;
+						row_classes[k] = "changed";
+						++counts.changed;
+					}
+					else
+					{ ++counts.inserted; }
+				}
+
+				// Old entries are only known by their hashes, so removed entries can only be counted
+				for(auto const& item : prev_keys)
+				{ counts.removed += item.second; }
+			}
+			else
+			{
+				// Like for sequences, everything is inserted on the first call
+				counts.inserted = size;
+			}
+
+			puts("<table class=\"diff\">");
+			print_diff_summary(key, counts, size);
+			size_t k = 0;
+			std::ranges::for_each(range, [&k, &row_classes, prev, &options](auto const& item) {
+				auto const row_class = row_classes[k++];
+				if(prev == nullptr || row_class != nullptr || options.show_all)
+				{
+					print_diff_row_begin(row_class);
+					print_diff_cells(item);
+					puts("</tr>");
+				}
+			});
+
+			if(counts.removed != 0)
+			{
+				write_raw("<tr class=\"removed\"><td colspan=\"2\">");
+				write_as_html(counts.removed);
+				puts(" removed</td></tr>");
+			}
+			puts("</table>");
+			return ret;
+		}
+	}
+
+	// Prints the rows of value that changed since the last call with the same key
+	template<std::ranges::forward_range R>
+	requires(std::ranges::sized_range<R> && !detail::string_like<R>)
+	void print_diff(std::string_view key, R const& value,
+		print_diff_options const& options = print_diff_options{})
+	{
+		atomic_write([key, &options](R const& value) {
+			auto const i = detail::diff_snapshots.find(key);
+			auto const prev = i != std::end(detail::diff_snapshots) ? &i->second : nullptr;
+
+			auto snapshot = [&]() {
+				if constexpr(detail::associative_container<R>)
+				{ return detail::print_associative_diff(key, value, prev, options); }
+				else
+				{ return detail::print_sequence_diff(key, value, prev, options); }
+			}();
+			snapshot.last_use = detail::diff_use_count++;
+
+			auto stored = i;
+			if(prev != nullptr)
+			{
+				detail::diff_snapshots_by_use.erase(prev->last_use);
+				detail::diff_snapshots_size -= prev->size_in_bytes();
+				detail::diff_snapshots_size += snapshot.size_in_bytes();
+				*prev = std::move(snapshot);
+			}
+			else
+			{
+				detail::diff_snapshots_size += snapshot.size_in_bytes();
+				stored = detail::diff_snapshots.emplace(std::string{key}, std::move(snapshot)).first;
+			}
+			detail::diff_snapshots_by_use.emplace(stored->second.last_use, stored);
+			detail::trim_diff_snapshots();
+		}, value);
+	}
+}
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef PRETTY_LIVE_HPP
+#define PRETTY_LIVE_HPP
+
+#include "./base.hpp"
+#include "./plot.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace pretty
+{
+	// Updates to a live slot are sent at most this often. The latest state is always sent when
+	// the slot goes out of scope.
+	inline constinit std::chrono::steady_clock::duration live_update_interval =
+		std::chrono::milliseconds{50};
+
+	namespace detail
+	{
+		// Protected by output_mutex
+		inline constinit size_t live_slot_count = 0;
+
+		class live_slot
+		{
+		public:
+			template<class Function>
+			explicit live_slot(Function&& write_content)
+			{
+				atomic_write([this](auto const& write_content) {
+					m_id = live_slot_count++;
+					write_raw("<div class=\"live\" id=\"");
+					write_id();
+					write_raw("\">");
+					write_content();
+					puts("</div>");
+				}, write_content);
+				m_last_update = std::chrono::steady_clock::now();
+			}
+
+			live_slot(live_slot const&) = delete;
+			live_slot& operator=(live_slot const&) = delete;
+
+			bool update_allowed() const
+			{ return std::chrono::steady_clock::now() - m_last_update >= live_update_interval; }
+
+			// Sends content to the page. Mode is either "replace", which replaces the content of
+			// the slot, or "append-points", which appends coordinates to the first polyline in it.
+			template<class Function>
+			void update(char const* mode, Function&& write_content)
+			{
+				atomic_write([this, mode](auto const& write_content) {
+					write_raw("<template data-live-target=\"");
+					write_id();
+					write_raw("\" data-live-mode=\"");
+					write_raw(mode);
+					write_raw("\">");
+					write_content();
+					puts("</template>");
+				}, write_content);
+				m_last_update = std::chrono::steady_clock::now();
+			}
+
+		private:
+			void write_id() const
+			{
+				write_raw("pretty_live_");
+				write_raw(std::data(to_char_buffer(m_id)));
+			}
+
+			size_t m_id{0};
+			std::chrono::steady_clock::time_point m_last_update;
+		};
+	}
+
+	template<class T>
+	class live
+	{
+	public:
+		[[nodiscard]] explicit live(std::string_view name, T const& initial_value = T{}):
+			m_name{name},
+			m_value{initial_value},
+			m_dirty{false},
+			m_slot{[this](){ write_labeled_value(m_name, m_value); }}
+		{}
+
+		~live()
+		{
+			if(m_dirty)
+			{ flush(); }
+		}
+
+		live& operator=(T const& value)
+		{
+			update(value);
+			return *this;
+		}
+
+		void update(T const& value)
+		{
+			m_value = value;
+			m_dirty = true;
+			if(m_slot.update_allowed())
+			{ flush(); }
+		}
+
+		void flush()
+		{
+			m_slot.update("replace", [this](){ write_labeled_value(m_name, m_value); });
+			m_dirty = false;
+		}
+
+		T const& value() const
+		{ return m_value; }
+
+	private:
+		std::string m_name;
+		T m_value;
+		bool m_dirty;
+		detail::live_slot m_slot;
+	};
+
+	template<arithmetic X, arithmetic Y>
+	class live_plot
+	{
+	public:
+		using point_type = std::pair<X, Y>;
+
+		[[nodiscard]] explicit live_plot(plot_params_2d<X, Y> const& plot_params = plot_params_2d<X, Y>{}):
+			m_params{plot_params},
+			m_fixed_x_range{plot_params.x_range.has_value()},
+			m_fixed_y_range{plot_params.y_range.has_value()},
+			m_points_sent{0},
+			m_curves{&m_points, 1},
+			m_slot{[](){}}
+		{}
+
+		~live_plot()
+		{
+			if(m_points_sent != std::size(m_points))
+			{ flush(); }
+		}
+
+		void append(X x, Y y)
+		{
+			if(!output_enabled())
+			{ return; }
+
+			m_points.push_back(point_type{x, y});
+			if(m_slot.update_allowed())
+			{ flush(); }
+		}
+
+		template<plot_data_2d PlotData>
+		void append(PlotData const& points)
+		{
+			if(!output_enabled())
+			{ return; }
+
+			std::ranges::for_each(points, [this](auto const& item) {
+				m_points.push_back(point_type{get<0>(item), get<1>(item)});
+			});
+			if(m_slot.update_allowed())
+			{ flush(); }
+		}
+
+		void flush()
+		{
+			if(std::size(m_points) == 0)
+			{ return; }
+
+			std::span const new_points{std::begin(m_points) + m_points_sent, std::end(m_points)};
+			// Only the polyline is patched, so markers and density images need a full update
+			if(m_points_sent == 0 || m_params.marker.has_value() || m_params.density.has_value()
+				|| !in_range(new_points))
+			{
+				update_ranges();
+				m_slot.update("replace", [this](){ make_context()(); });
+			}
+			else
+			{
+				m_slot.update("append-points", [this, new_points](){
+					auto const context = make_context();
+					std::ranges::for_each(new_points, [&context](auto const& item) {
+						context.write_point(item);
+					});
+				});
+			}
+			m_points_sent = std::size(m_points);
+		}
+
+		std::vector<point_type> const& points() const
+		{ return m_points; }
+
+	private:
+		using plot_data = std::span<std::vector<point_type> const, 1>;
+
+		plot_params_2d<X, Y> m_params;
+		bool m_fixed_x_range;
+		bool m_fixed_y_range;
+		std::vector<point_type> m_points;
+		size_t m_points_sent;
+		plot_data m_curves;
+		detail::live_slot m_slot;
+
+		plot_context_2d<plot_data> make_context() const
+		{ return plot_context_2d{m_curves, m_params}; }
+
+		bool in_range(std::span<point_type const> points) const
+		{
+			return std::ranges::all_of(points, [x_range = *m_params.x_range, y_range = *m_params.y_range]
+				(auto const& item) {
+				return item.first >= x_range.min && item.first <= x_range.max
+					&& item.second >= y_range.min && item.second <= y_range.max;
+			});
+		}
+
+		template<size_t Element, class Value>
+		plot_axis_range<Value> grown_range() const
+		{
+			// Leave some headroom, so that the plot does not have to be redrawn for every new point
+			auto const range = compute_range<Element>(m_points);
+			auto const length = static_cast<double>(range.max - range.min);
+			auto const margin = length != 0.0 ? 0.25*length : 1.0;
+			return plot_axis_range{static_cast<Value>(static_cast<double>(range.min) - margin),
+				static_cast<Value>(static_cast<double>(range.max) + margin)};
+		}
+
+		void update_ranges()
+		{
+			if(!m_fixed_x_range)
+			{ m_params.x_range = grown_range<0, X>(); }
+			if(!m_fixed_y_range)
+			{ m_params.y_range = grown_range<1, Y>(); }
+		}
+	};
+}
+
+#endif
@@ -2,10 +2,13 @@
 #define PRETTY_PLOT_HPP
 
 #include "./base.hpp"
+#include "./png.hpp"
 
 #include <cmath>
 #include <span>
 #include <cassert>
+#include <thread>
+#include <vector>
 
 namespace pretty
 {
@@ -30,6 +33,25 @@ namespace pretty
 		return std::pow(tick_base, logl - 1.0);
 	}
 
+	enum class plot_colormap
+	{
+		viridis,
+		grayscale
+	};
+
+	// Draws the density of points as an image, instead of drawing every point. Use it for scatter
+	// plots with many points.
+	struct plot_density
+	{
+		// Number of bins along the longer axis
+		size_t resolution = 256;
+
+		// Map log(1 + count) to color, so that sparse regions stay visible next to dense ones
+		bool log_scale = true;
+
+		plot_colormap colormap = plot_colormap::viridis;
+	};
+
 	template<arithmetic X, arithmetic Y>
 	struct plot_params_2d
 	{
@@ -43,6 +65,8 @@ namespace pretty
 
 		// TODO: Marker should have a size and a color...
 		std::optional<std::type_identity<void>> marker;
+
+		std::optional<plot_density> density;
 	};
 
 	template<class T>
@@ -122,6 +146,141 @@ namespace pretty
 		}
 	}
 
+	namespace detail
+	{
+		inline std::array<uint8_t, 3> map_color(plot_colormap colormap, double t)
+		{
+			if(colormap == plot_colormap::grayscale)
+			{
+				auto const val = static_cast<uint8_t>(std::lround(224.0*(1.0 - t)));
+				return std::array{val, val, val};
+			}
+
+			constexpr std::array<std::array<double, 3>, 9> viridis{{
+				{68, 1, 84}, {71, 44, 122}, {59, 81, 139}, {44, 113, 142}, {33, 144, 141},
+				{39, 173, 129}, {92, 200, 99}, {170, 220, 50}, {253, 231, 37}
+			}};
+			auto const pos = t*static_cast<double>(std::size(viridis) - 1);
+			auto const k = std::min(static_cast<size_t>(pos), std::size(viridis) - 2);
+			auto const frac = pos - static_cast<double>(k);
+			std::array<uint8_t, 3> ret{};
+			for(size_t l = 0; l != 3; ++l)
+			{
+				ret[l] = static_cast<uint8_t>(std::lround((1.0 - frac)*viridis[k][l]
+					+ frac*viridis[k + 1][l]));
+			}
+			return ret;
+		}
+
+		class density_grid
+		{
+		public:
+			template<arithmetic X, arithmetic Y>
+			explicit density_grid(plot_axis_range<X> x_range, plot_axis_range<Y> y_range,
+				size_t width, size_t height):
+				m_width{width},
+				m_height{height},
+				m_x_min{static_cast<double>(x_range.min)},
+				m_y_max{static_cast<double>(y_range.max)},
+				m_x_scale{static_cast<double>(width)/static_cast<double>(x_range.max - x_range.min)},
+				m_y_scale{static_cast<double>(height)/static_cast<double>(y_range.max - y_range.min)},
+				m_counts(width*height)
+			{}
+
+			// Large random-access curves are split between parallel_format_threads threads, each
+			// with its own counts
+			template<plot_data_2d Curve>
+			void add(Curve const& curve)
+			{
+				if constexpr(std::ranges::random_access_range<Curve const> && std::ranges::sized_range<Curve const>)
+				{
+					auto const size = std::ranges::size(curve);
+					auto const thread_count = parallel_format_thread_count();
+					if(size >= parallel_format_threshold && thread_count > 1)
+					{
+						auto const part_size = (size + thread_count - 1)/thread_count;
+						std::vector<std::vector<size_t>> partial_counts(thread_count - 1,
+							std::vector<size_t>(std::size(m_counts)));
+						{
+							std::vector<std::jthread> workers;
+							workers.reserve(thread_count - 1);
+							for(size_t k = 1; k != thread_count; ++k)
+							{
+								workers.emplace_back([this, &curve, &partial_counts, k, part_size, size]() {
+									add(curve, std::min(k*part_size, size), std::min((k + 1)*part_size, size),
+										partial_counts[k - 1]);
+								});
+							}
+							add(curve, 0, std::min(part_size, size), m_counts);
+						}
+
+						for(auto const& counts : partial_counts)
+						{ std::ranges::transform(m_counts, counts, std::begin(m_counts), std::plus{}); }
+						return;
+					}
+				}
+
+				std::ranges::for_each(curve, [this](auto const& item){ add(item, m_counts); });
+			}
+
+			std::vector<uint8_t> make_pixels(plot_density const& params) const
+			{
+				auto const max_count = static_cast<double>(std::ranges::max(m_counts));
+				auto const norm = params.log_scale ? std::log1p(max_count) : max_count;
+				std::vector<uint8_t> ret(std::size(m_counts));
+				std::ranges::transform(m_counts, std::begin(ret), [&params, norm](size_t count) {
+					if(count == 0)
+					{ return uint8_t{0}; }
+
+					auto const val = static_cast<double>(count);
+					auto const t = (params.log_scale ? std::log1p(val) : val)/norm;
+					return static_cast<uint8_t>(1 + std::lround(254.0*t));
+				});
+				return ret;
+			}
+
+			size_t width() const
+			{ return m_width; }
+
+			size_t height() const
+			{ return m_height; }
+
+		private:
+			size_t m_width;
+			size_t m_height;
+			double m_x_min;
+			double m_y_max;
+			double m_x_scale;
+			double m_y_scale;
+			std::vector<size_t> m_counts;
+
+			template<plot_point_2d Point>
+			void add(Point const& item, std::vector<size_t>& counts) const
+			{
+				// Row 0 is at the top, where y is largest
+				auto const u = (static_cast<double>(get<0>(item)) - m_x_min)*m_x_scale;
+				auto const v = (m_y_max - static_cast<double>(get<1>(item)))*m_y_scale;
+				if(!(u >= 0.0 && v >= 0.0 && u <= static_cast<double>(m_width)
+					&& v <= static_cast<double>(m_height)))
+				{ return; }
+
+				auto const col = std::min(static_cast<size_t>(u), m_width - 1);
+				auto const row = std::min(static_cast<size_t>(v), m_height - 1);
+				++counts[row*m_width + col];
+			}
+
+			template<class Curve>
+			void add(Curve const& curve, size_t first, size_t last, std::vector<size_t>& counts) const
+			{
+				using difference_type = std::ranges::range_difference_t<Curve>;
+				auto const begin = std::ranges::begin(curve);
+				std::for_each(begin + static_cast<difference_type>(first),
+					begin + static_cast<difference_type>(last),
+					[this, &counts](auto const& item){ add(item, counts); });
+			}
+		};
+	}
+
 	inline constexpr std::string_view curve_ids{"0123456789abcdef"};
 	static_assert(std::size(curve_ids) == 16);
 
@@ -135,9 +294,10 @@ namespace pretty
 		explicit plot_context_2d(R const& plot_data,
 			plot_params_2d_t<PlotData> const& plot_params):
 			m_plot_data{plot_data},
-			m_x_range{plot_params.x_range.value_or(compute_range<0>(plot_data))},
-			m_y_range{plot_params.x_range.value_or(compute_range<1>(plot_data))},
-			m_marker{plot_params.marker}
+			m_x_range{plot_params.x_range.has_value()? *plot_params.x_range : compute_range<0>(plot_data)},
+			m_y_range{plot_params.y_range.has_value()? *plot_params.y_range : compute_range<1>(plot_data)},
+			m_marker{plot_params.marker},
+			m_density{plot_params.density}
 		{
 			assert(!m_x_range.empty());
 			assert(!m_y_range.empty());
@@ -177,15 +337,13 @@ namespace pretty
 			write_raw(std::data(to_char_buffer(m_h + 2.5*text_height)));
 			puts("\">");
 
-			auto const print_coord = [scale = m_scale, y_range = m_y_range](auto const& item) {
-				auto const x = scale*get<0>(item);
-				auto const y = scale*(y_range.max + y_range.min - get<1>(item));
-				write_raw(std::data(to_char_buffer(x)));
-				putchar(',');
-				write_raw(std::data(to_char_buffer(y)));
-				putchar(' ');
+			auto const print_coord = [this](auto const& item) {
+				write_point(item);
 			};
 
+			if(m_density.has_value())
+			{ write_density_image(); }
+			else
 			if(m_marker.has_value())
 			{
 				auto const draw_marker = [scale = m_scale, y_range = m_y_range](auto const& item) {
@@ -203,7 +361,10 @@ namespace pretty
 					write_raw("<polyline class=\"curve_");
 					putchar(curve_ids[k%std::size(curve_ids)]);
 					write_raw("\" stroke=\"blue\" stroke-width=\"1\" fill=\"none\" points=\"");
-					std::ranges::for_each(curve, print_coord);
+					{
+						detail::record_frame frame{points_are_recordable};
+						std::ranges::for_each(curve, print_coord);
+					}
 					++k;
 					puts("\"/>");
 
@@ -217,7 +378,10 @@ namespace pretty
 					write_raw("<polyline class=\"curve_");
 					putchar(curve_ids[k%std::size(curve_ids)]);
 					write_raw("\" stroke=\"blue\" stroke-width=\"1\" fill=\"none\" points=\"");
-					std::ranges::for_each(curve, print_coord);
+					{
+						detail::record_frame frame{points_are_recordable};
+						std::ranges::for_each(curve, print_coord);
+					}
 					++k;
 					puts("\"/>");
 				});
@@ -304,12 +468,66 @@ namespace pretty
 			puts("</svg>");
 		}
 
+		void write_density_image() const
+		{
+			auto const resolution = static_cast<double>(std::max(m_density->resolution, size_t{1}));
+			auto const longest_side = std::max(m_w, m_h);
+			detail::density_grid grid{m_x_range, m_y_range,
+				std::max(static_cast<size_t>(std::lround(resolution*m_w/longest_side)), size_t{1}),
+				std::max(static_cast<size_t>(std::lround(resolution*m_h/longest_side)), size_t{1})};
+			std::ranges::for_each(m_plot_data.get(), [&grid](auto const& curve){ grid.add(curve); });
+
+			std::array<std::array<uint8_t, 3>, 256> palette{};
+			for(size_t k = 1; k != std::size(palette); ++k)
+			{ palette[k] = detail::map_color(m_density->colormap, static_cast<double>(k - 1)/254.0); }
+
+			auto const pixels = grid.make_pixels(*m_density);
+			write_raw("<image class=\"density\" preserveAspectRatio=\"none\" x=\"");
+			write_raw(std::data(m_x_min_chars));
+			write_raw("\" y=\"");
+			write_raw(std::data(m_y_min_chars));
+			write_raw("\" width=\"");
+			write_raw(std::data(to_char_buffer(m_w)));
+			write_raw("\" height=\"");
+			write_raw(std::data(to_char_buffer(m_h)));
+			write_raw("\" href=\"data:image/png;base64,");
+			detail::write_base64(detail::make_indexed_png(grid.width(), grid.height(), palette, pixels));
+			detail::write_line("\"/>");
+		}
+
+		template<plot_point_2d Point>
+		void write_point(Point const& item) const
+		{
+			auto const x = m_scale*get<0>(item);
+			auto const y = m_scale*(m_y_range.max + m_y_range.min - get<1>(item));
+			if constexpr(std::is_same_v<decltype(x), double const> && std::is_same_v<decltype(y), double const>)
+			{
+				if(detail::recording)
+				{
+					detail::write_token(detail::record_token::point);
+					detail::write_bytes(&x, sizeof(x));
+					detail::write_bytes(&y, sizeof(y));
+					return;
+				}
+			}
+
+			write_raw(std::data(to_char_buffer(x)));
+			putchar(',');
+			write_raw(std::data(to_char_buffer(y)));
+			putchar(' ');
+		}
+
 	private:
 		std::reference_wrapper<R const> m_plot_data;
 
 		using x_type = typename plot_2d_coord_types<PlotData>::x_type;
 		using y_type = typename plot_2d_coord_types<PlotData>::y_type;
 
+		// Points are sent as binary doubles in the record format, unless they have more precision
+		static constexpr bool points_are_recordable =
+			std::is_same_v<decltype(std::declval<double>()*std::declval<x_type>()), double>
+			&& std::is_same_v<decltype(std::declval<double>()*std::declval<y_type>()), double>;
+
 		plot_axis_range<x_type> m_x_range;
 		plot_axis_range<y_type> m_y_range;
 		double m_scale;
@@ -326,12 +544,16 @@ namespace pretty
 		std::array<char, 32> m_y_min_chars;
 		std::array<char, 32> m_y_max_chars;
 		std::optional<std::type_identity<void>> m_marker;
+		std::optional<plot_density> m_density;
 	};
 
 	template<plot_data_2d PlotData>
 	void plot(PlotData const& plot_data,
 		plot_params_2d_t<PlotData> const& plot_params = plot_params_2d_t<PlotData>{})
 	{
+		if(!output_enabled())
+		{ return; }
+
 		atomic_write(plot_context_2d{std::span<PlotData const, 1>{&plot_data, 1}, plot_params});
 	}
 
@@ -340,6 +562,9 @@ namespace pretty
 	void plot(R const& plot_data,
 		plot_params_2d_t<std::ranges::range_value_t<R>> const& plot_params = plot_params_2d_t<std::ranges::range_value_t<R>>{})
 	{
+		if(!output_enabled())
+		{ return; }
+
 		atomic_write(plot_context_2d{plot_data, plot_params});
 	}
 }
@@ -0,0 +1,146 @@
+#ifndef PRETTY_PNG_HPP
+#define PRETTY_PNG_HPP
+
+#include "./base.hpp"
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace pretty::detail
+{
+	inline constexpr auto crc32_table = [](){
+		std::array<uint32_t, 256> ret{};
+		for(uint32_t k = 0; k != 256; ++k)
+		{
+			auto c = k;
+			for(int l = 0; l != 8; ++l)
+			{ c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1; }
+			ret[k] = c;
+		}
+		return ret;
+	}();
+
+	inline uint32_t crc32(std::string_view data)
+	{
+		uint32_t ret = 0xffffffffu;
+		for(auto item : data)
+		{ ret = crc32_table[(ret ^ static_cast<uint8_t>(item)) & 0xff] ^ (ret >> 8); }
+		return ret ^ 0xffffffffu;
+	}
+
+	inline uint32_t adler32(std::string_view data)
+	{
+		uint32_t a = 1;
+		uint32_t b = 0;
+		for(auto item : data)
+		{
+			a = (a + static_cast<uint8_t>(item)) % 65521;
+			b = (b + a) % 65521;
+		}
+		return (b << 16) | a;
+	}
+
+	inline void append_be32(std::string& dest, uint32_t val)
+	{
+		dest.push_back(static_cast<char>(val >> 24));
+		dest.push_back(static_cast<char>(val >> 16));
+		dest.push_back(static_cast<char>(val >> 8));
+		dest.push_back(static_cast<char>(val));
+	}
+
+	inline void append_png_chunk(std::string& dest, std::string_view type, std::string_view data)
+	{
+		append_be32(dest, static_cast<uint32_t>(std::size(data)));
+		std::string type_and_data{type};
+		type_and_data.append(data);
+		dest.append(type_and_data);
+		append_be32(dest, crc32(type_and_data));
+	}
+
+	// A zlib stream made of stored blocks. The images are small, so compression is not worth the
+	// code.
+	inline std::string make_stored_zlib_stream(std::string_view data)
+	{
+		std::string ret{"\x78\x01", 2};
+		do
+		{
+			auto const block_size = std::min(std::size(data), size_t{65535});
+			auto const is_last = block_size == std::size(data);
+			ret.push_back(is_last ? 1 : 0);
+			ret.push_back(static_cast<char>(block_size & 0xff));
+			ret.push_back(static_cast<char>(block_size >> 8));
+			ret.push_back(static_cast<char>(~block_size & 0xff));
+			ret.push_back(static_cast<char>((~block_size >> 8) & 0xff));
+			ret.append(data.substr(0, block_size));
+			data.remove_prefix(block_size);
+		}
+		while(std::size(data) != 0);
+		return ret;
+	}
+
+	// Encodes an image with 8-bit palette indices as PNG. Palette entry 0 is transparent.
+	inline std::string make_indexed_png(size_t width, size_t height,
+		std::span<std::array<uint8_t, 3> const, 256> palette, std::span<uint8_t const> pixels)
+	{
+		std::string ret{"\x89PNG\r\n\x1a\n", 8};
+
+		std::string header;
+		append_be32(header, static_cast<uint32_t>(width));
+		append_be32(header, static_cast<uint32_t>(height));
+		header.append(std::string_view{"\x08\x03\x00\x00\x00", 5});
+		append_png_chunk(ret, "IHDR", header);
+
+		std::string palette_data;
+		for(auto const& item : palette)
+		{ palette_data.append(reinterpret_cast<char const*>(std::data(item)), 3); }
+		append_png_chunk(ret, "PLTE", palette_data);
+		append_png_chunk(ret, "tRNS", std::string_view{"\x00", 1});
+
+		std::string scanlines;
+		scanlines.reserve((width + 1)*height);
+		for(size_t row = 0; row != height; ++row)
+		{
+			// Filter type none
+			scanlines.push_back(0);
+			scanlines.append(reinterpret_cast<char const*>(std::data(pixels)) + row*width, width);
+		}
+		auto idat = make_stored_zlib_stream(scanlines);
+		append_be32(idat, adler32(scanlines));
+		append_png_chunk(ret, "IDAT", idat);
+		append_png_chunk(ret, "IEND", std::string_view{});
+		return ret;
+	}
+
+	inline void write_base64(std::string_view data)
+	{
+		constexpr std::string_view digits{
+			"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"};
+		std::array<char, 4> quad{};
+		size_t k = 0;
+		for(; k + 3 <= std::size(data); k += 3)
+		{
+			uint32_t const val = (static_cast<uint32_t>(static_cast<uint8_t>(data[k])) << 16)
+				| (static_cast<uint32_t>(static_cast<uint8_t>(data[k + 1])) << 8)
+				| static_cast<uint32_t>(static_cast<uint8_t>(data[k + 2]));
+			quad = {digits[val >> 18], digits[(val >> 12) & 0x3f], digits[(val >> 6) & 0x3f],
+				digits[val & 0x3f]};
+			write_raw(std::string_view{std::data(quad), 4});
+		}
+
+		auto const remaining = std::size(data) - k;
+		if(remaining == 0)
+		{ return; }
+
+		uint32_t val = static_cast<uint32_t>(static_cast<uint8_t>(data[k])) << 16;
+		if(remaining == 2)
+		{ val |= static_cast<uint32_t>(static_cast<uint8_t>(data[k + 1])) << 8; }
+		quad = {digits[val >> 18], digits[(val >> 12) & 0x3f],
+			remaining == 2 ? digits[(val >> 6) & 0x3f] : '=', '='};
+		write_raw(std::string_view{std::data(quad), 4});
+	}
+}
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef PRETTY_SHM_TRANSPORT_HPP
+#define PRETTY_SHM_TRANSPORT_HPP
+
+#ifdef __linux__
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <optional>
+#include <iostream>
+#include <streambuf>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pretty::shm_transport
+{
+	// Layout of the shared ring. Must match server/shm_transport.py
+	inline constexpr size_t write_pos_offset = 0;
+	inline constexpr size_t read_pos_offset = 64;
+	// Set by the server before it sleeps. Only then does the writer need to ring the doorbell.
+	inline constexpr size_t reader_waiting_offset = 128;
+	// Set by the writer while it waits for space. Only then does the server signal space_ready.
+	inline constexpr size_t writer_waiting_offset = 192;
+	inline constexpr size_t data_offset = 256;
+
+	// The server cannot issue a memory fence, so either side may miss a wakeup. Waiting for space
+	// is therefore bounded by this timeout, and the server does the same.
+	inline constexpr int wait_timeout_ms = 10;
+
+	inline std::optional<int> get_fd_from_env(char const* name)
+	{
+		auto const val = getenv(name);
+		if(val == nullptr)
+		{ return std::nullopt; }
+
+		std::string_view str{val};
+		int ret{};
+		auto const res = std::from_chars(std::data(str), std::data(str) + std::size(str), ret);
+		if(res.ec != std::errc{} || res.ptr != std::data(str) + std::size(str))
+		{ return std::nullopt; }
+		return ret;
+	}
+
+	class ring_writer
+	{
+	public:
+		explicit ring_writer(int shm_fd, int data_ready_fd, int space_ready_fd):
+			m_data_ready_fd{data_ready_fd},
+			m_space_ready_fd{space_ready_fd}
+		{
+			struct stat st{};
+			if(fstat(shm_fd, &st) == -1 || static_cast<size_t>(st.st_size) <= data_offset)
+			{ return; }
+
+			auto const size = static_cast<size_t>(st.st_size);
+			auto const ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+			if(ptr == MAP_FAILED)
+			{ return; }
+
+			m_base = static_cast<std::byte*>(ptr);
+			m_capacity = size - data_offset;
+		}
+
+		bool valid() const
+		{ return m_base != nullptr; }
+
+		size_t write(char const* buffer, size_t n)
+		{
+			auto const ret = n;
+			auto const write_pos = position(write_pos_offset);
+			auto const read_pos = position(read_pos_offset);
+			while(n != 0)
+			{
+				auto const wp = write_pos.load(std::memory_order_relaxed);
+				auto const rp = read_pos.load(std::memory_order_acquire);
+				auto const bytes_free = m_capacity - static_cast<size_t>(wp - rp);
+				if(bytes_free == 0)
+				{
+					wait_for_space(wp);
+					continue;
+				}
+
+				auto const offset = static_cast<size_t>(wp % m_capacity);
+				auto const k = std::min({n, bytes_free, m_capacity - offset});
+				memcpy(m_base + data_offset + offset, buffer, k);
+				write_pos.store(wp + k, std::memory_order_release);
+				buffer += k;
+				n -= k;
+			}
+			wake_reader();
+			return ret;
+		}
+
+	private:
+		std::atomic_ref<uint64_t> position(size_t offset) const
+		{ return std::atomic_ref{*reinterpret_cast<uint64_t*>(m_base + offset)}; }
+
+		std::atomic_ref<uint32_t> flag(size_t offset) const
+		{ return std::atomic_ref{*reinterpret_cast<uint32_t*>(m_base + offset)}; }
+
+		// Rings the doorbell only if the server has announced that it is about to sleep. While it
+		// is draining, it picks up new data without being woken.
+		void wake_reader()
+		{
+			auto const reader_waiting = flag(reader_waiting_offset);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(reader_waiting.load(std::memory_order_relaxed) != 0
+				&& reader_waiting.exchange(0, std::memory_order_relaxed) != 0)
+			{ notify(m_data_ready_fd); }
+		}
+
+		void wait_for_space(uint64_t wp)
+		{
+			auto const writer_waiting = flag(writer_waiting_offset);
+			writer_waiting.store(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if(position(read_pos_offset).load(std::memory_order_acquire) + m_capacity == wp)
+			{
+				// The ring is full, so the server must run. Wake it up even if it has not asked for it.
+				notify(m_data_ready_fd);
+				pollfd pfd{m_space_ready_fd, POLLIN, 0};
+				if(poll(&pfd, 1, wait_timeout_ms) == 1)
+				{
+					eventfd_t val{};
+					eventfd_read(m_space_ready_fd, &val);
+				}
+			}
+			writer_waiting.store(0, std::memory_order_relaxed);
+		}
+
+		static void notify(int fd)
+		{ eventfd_write(fd, 1); }
+
+		std::byte* m_base{nullptr};
+		size_t m_capacity{0};
+		int m_data_ready_fd;
+		int m_space_ready_fd;
+	};
+
+	// Forwards std::cout to whatever stdout currently is, so that it goes through the ring as well,
+	// in the same order as output from the pretty library
+	class stdout_buffer : public std::streambuf
+	{
+	protected:
+		int_type overflow(int_type ch) override
+		{
+			if(traits_type::eq_int_type(ch, traits_type::eof()))
+			{ return traits_type::not_eof(ch); }
+			return putchar(traits_type::to_char_type(ch)) == EOF ? traits_type::eof() : ch;
+		}
+
+		std::streamsize xsputn(char const* buffer, std::streamsize n) override
+		{ return static_cast<std::streamsize>(fwrite(buffer, 1, static_cast<size_t>(n), stdout)); }
+
+		int sync() override
+		{ return fflush(stdout) == 0 ? 0 : -1; }
+	};
+
+	inline FILE* open_stream()
+	{
+		auto const shm_fd = get_fd_from_env("PRETTY_SHM_FD");
+		auto const data_ready_fd = get_fd_from_env("PRETTY_SHM_DATA_READY_FD");
+		auto const space_ready_fd = get_fd_from_env("PRETTY_SHM_SPACE_READY_FD");
+		if(!shm_fd.has_value() || !data_ready_fd.has_value() || !space_ready_fd.has_value())
+		{ return nullptr; }
+
+		static ring_writer writer{*shm_fd, *data_ready_fd, *space_ready_fd};
+		if(!writer.valid())
+		{ return nullptr; }
+
+		cookie_io_functions_t const functions{
+			.read = nullptr,
+			.write = [](void* cookie, char const* buffer, size_t n) -> ssize_t {
+				return static_cast<ssize_t>(static_cast<ring_writer*>(cookie)->write(buffer, n));
+			},
+			.seek = nullptr,
+			.close = nullptr
+		};
+
+		auto const ret = fopencookie(&writer, "w", functions);
+		if(ret == nullptr)
+		{ return nullptr; }
+
+		// Output is pushed on every atomic_write anyway, so keep the buffer large
+		setvbuf(ret, nullptr, _IOFBF, 65536);
+		return ret;
+	}
+
+	// Replaces stdout with the shared-memory ring when the server offers one. Otherwise, output
+	// stays on the stdout pipe. std::cout is redirected as well. Output written directly to file
+	// descriptor 1, and everything written to stderr, still goes through the pipe, and is not
+	// ordered with respect to the ring.
+	inline bool const is_installed = []() {
+		auto const stream = open_stream();
+		if(stream == nullptr)
+		{ return false; }
+
+		std::ios_base::Init const init_streams{};
+		std::cout.flush();
+		fflush(stdout);
+		stdout = stream;
+
+		static stdout_buffer cout_buffer;
+		std::cout.rdbuf(&cout_buffer);
+		return true;
+	}();
+}
+
+#endif
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef PRETTY_THROTTLE_HPP
+#define PRETTY_THROTTLE_HPP
+
+#include "./base.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pretty
+{
+	namespace detail
+	{
+		struct throttle_site
+		{
+			std::atomic<size_t> calls{0};
+			std::atomic<size_t> suppressed{0};
+			std::atomic<std::chrono::steady_clock::rep> next_time{0};
+		};
+
+		// Every lambda has its own type, so this gives one site per call site
+		template<class Function>
+		inline constinit throttle_site throttle_site_of{};
+
+		inline void write_suppressed(size_t count)
+		{
+			write_raw("<p class=\"suppressed\">");
+			write_as_html(count);
+			puts(count == 1 ? " record suppressed</p>" : " records suppressed</p>");
+		}
+
+		template<class Function>
+		void print_throttled(size_t suppressed, Function&& func)
+		{
+			atomic_write([suppressed](auto& func) {
+				if(suppressed != 0)
+				{ write_suppressed(suppressed); }
+				func();
+			}, func);
+		}
+	}
+
+	// Calls func, which should print something, on the first and then on every n:th call. The number
+	// of calls skipped in between is printed before the output of func. Calls are counted separately
+	// for each lambda, so use a lambda written at the call site. With n == 0, func is never called.
+	template<std::invocable Function>
+	void print_every(size_t n, Function&& func)
+	{
+		if(n == 0 || !output_enabled())
+		{ return; }
+
+		auto& site = detail::throttle_site_of<std::remove_cvref_t<Function>>;
+		auto const count = site.calls.fetch_add(1, std::memory_order_relaxed);
+		if(count % n != 0)
+		{ return; }
+
+		detail::print_throttled(count != 0 ? n - 1 : 0, func);
+	}
+
+	// Like print_every, but calls func at most per_second times per second, and skips the rest. With
+	// per_second <= 0, func is never called.
+	template<std::invocable Function>
+	void print_at_most(double per_second, Function&& func)
+	{
+		if(!(per_second > 0.0) || !output_enabled())
+		{ return; }
+
+		using clock = std::chrono::steady_clock;
+		auto& site = detail::throttle_site_of<std::remove_cvref_t<Function>>;
+		auto const now = clock::now().time_since_epoch().count();
+		auto next_time = site.next_time.load(std::memory_order_relaxed);
+		// Capped at about 30 years, so that the interval fits in a clock::duration
+		auto const interval = std::chrono::duration_cast<clock::duration>(
+			std::chrono::duration<double>{std::min(1.0/per_second, 1.0e9)}).count();
+		if(now < next_time
+			|| !site.next_time.compare_exchange_strong(next_time, now + interval, std::memory_order_relaxed))
+		{
+			site.suppressed.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		detail::print_throttled(site.suppressed.exchange(0, std::memory_order_relaxed), func);
+	}
+
+	// Keeps a uniformly drawn sample of at most capacity of the added records, and prints them when
+	// it goes out of scope. With capacity == 0, records are only counted. Not thread-safe, so use one
+	// object per thread.
+	template<class T>
+	class reservoir_sample
+	{
+	public:
+		[[nodiscard]] explicit reservoir_sample(std::string_view name, size_t capacity,
+			uint64_t seed = 0):
+			m_name{name},
+			m_capacity{capacity},
+			m_seen{0},
+			m_next{0},
+			m_weight{1.0},
+			m_rng{seed}
+		{ m_records.reserve(capacity); }
+
+		~reservoir_sample()
+		{ print(); }
+
+		reservoir_sample(reservoir_sample const&) = delete;
+		reservoir_sample& operator=(reservoir_sample const&) = delete;
+
+		void add(T const& value)
+		{
+			auto const index = m_seen++;
+			if(m_capacity == 0)
+			{ return; }
+
+			if(std::size(m_records) < m_capacity)
+			{
+				m_records.push_back(std::pair{index, value});
+				if(std::size(m_records) == m_capacity)
+				{
+					m_weight = std::exp(std::log(uniform())/static_cast<double>(m_capacity));
+					skip_ahead(index);
+				}
+				return;
+			}
+
+			// Algorithm L: the number of records to skip is drawn up front, so skipped records only
+			// cost a comparison
+			if(index < m_next)
+			{ return; }
+
+			m_records[std::uniform_int_distribution<size_t>{0, m_capacity - 1}(m_rng)] = std::pair{index, value};
+			m_weight *= std::exp(std::log(uniform())/static_cast<double>(m_capacity));
+			skip_ahead(index);
+		}
+
+		size_t records_seen() const
+		{ return m_seen; }
+
+		void print()
+		{
+			if(m_seen == 0)
+			{ return; }
+
+			std::ranges::sort(m_records, [](auto const& a, auto const& b){ return a.first < b.first; });
+			atomic_write([this](){
+				puts("<table class=\"sample\">");
+				write_raw("<caption>");
+				write_as_html(m_name);
+				write_raw(": ");
+				write_as_html(std::size(m_records));
+				write_raw(" of ");
+				write_as_html(m_seen);
+				write_raw(" records, ");
+				write_as_html(m_seen - std::size(m_records));
+				puts(" suppressed</caption>");
+				std::ranges::for_each(m_records, [](auto const& item) {
+					write_raw("<tr>");
+					print_table_cell(item.first);
+					print_table_cell(item.second);
+					puts("</tr>");
+				});
+				puts("</table>");
+			});
+			m_records.clear();
+			m_seen = 0;
+			m_next = 0;
+			m_weight = 1.0;
+		}
+
+	private:
+		std::string m_name;
+		size_t m_capacity;
+		size_t m_seen;
+		size_t m_next;
+		double m_weight;
+		std::mt19937_64 m_rng;
+		std::vector<std::pair<size_t, T>> m_records;
+
+		double uniform()
+		{
+			// Open interval, since the logarithm of 0 is undefined
+			return std::uniform_real_distribution<double>{std::numeric_limits<double>::min(), 1.0}(m_rng);
+		}
+
+		void skip_ahead(size_t index)
+		{
+			auto const skip = std::floor(std::log(uniform())/std::log1p(-m_weight));
+			m_next = skip < static_cast<double>(std::numeric_limits<size_t>::max() - index - 1)
+				? index + 1 + static_cast<size_t>(skip)
+				: std::numeric_limits<size_t>::max();
+		}
+	};
+}
+
+#endif
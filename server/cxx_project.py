@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+
+import os
+import json
+import hashlib
+import threading
+import shutil
+import fcntl
+import subprocess
+from pathlib import Path
+
+manifest_name = 'pretty_project.txt'
+source_suffixes = ['.cpp', '.cxx', '.cc', '.c++']
+
+def hash_bytes(*items):
+	h = hashlib.blake2b(digest_size = 20)
+	for item in items:
+		h.update(len(item).to_bytes(8, 'little'))
+		h.update(item)
+	return h.hexdigest()
+
+def hash_file(path):
+	try:
+		with open(path, 'rb') as f:
+			return hash_bytes(f.read())
+	except OSError:
+		return None
+
+def find_system_include_dirs(compiler):
+	'''Returns the directories that compiler searches for #include <...> by default'''
+	try:
+		output = subprocess.run([compiler, '-E', '-Wp,-v', '-xc++', os.devnull, '-o', os.devnull],
+			stdin = subprocess.DEVNULL, stdout = subprocess.DEVNULL, stderr = subprocess.PIPE,
+			timeout = 30).stderr.decode('utf-8', errors = 'replace')
+	except (OSError, subprocess.SubprocessError):
+		return []
+
+	ret = []
+	in_list = False
+	for line in output.splitlines():
+		if line.startswith('#include <...> search starts here:'):
+			in_list = True
+		elif line.startswith('End of search list.'):
+			break
+		elif in_list:
+			ret.append(os.path.normpath(line.strip()) + os.sep)
+	return ret
+
+def file_stamp(path):
+	try:
+		st = os.stat(path)
+		return [st.st_mtime_ns, st.st_size]
+	except OSError:
+		return None
+
+class Source:
+	def __init__(self, name, path, content, include_dir):
+		# name is how the source is presented, path is the file passed to the compiler
+		self.name = name
+		self.path = path
+		self.content = content
+		self.include_dir = include_dir
+
+def read_manifest(manifest):
+	'''Returns the sources listed in manifest. Each line names a source file or a directory,
+	relative to the manifest. For a directory, all C++ sources in it are used. Lines starting with
+	# are ignored.'''
+	ret = []
+	root = manifest.parent
+	with open(manifest, 'rb') as f:
+		for line in f.read().decode('utf-8').splitlines():
+			line = line.strip()
+			if len(line) == 0 or line.startswith('#'):
+				continue
+
+			path = (root / line).resolve()
+			if path.is_dir():
+				ret.extend(sorted(item for item in path.iterdir()
+					if item.is_file() and item.suffix in source_suffixes))
+			else:
+				ret.append(path)
+	return ret
+
+def collect_sources(edited_file, edited_content, temp_dir):
+	'''Returns the sources of the project that edited_file belongs to. The content of edited_file
+	is taken from the editor rather than from disk.'''
+	edited_path = temp_dir / 'src.cpp'
+	with open(edited_path, 'wb') as f:
+		f.write(edited_content)
+
+	if edited_file == None:
+		return [Source('src.cpp', edited_path, edited_content, Path('.'))]
+
+	edited_file = edited_file.resolve()
+	ret = [Source(edited_file.name, edited_path, edited_content, edited_file.parent)]
+	manifest = edited_file.parent / manifest_name
+	if not manifest.is_file():
+		return ret
+
+	for path in read_manifest(manifest):
+		if path == edited_file:
+			continue
+		with open(path, 'rb') as f:
+			ret.append(Source(str(path.relative_to(edited_file.parent)
+				if path.is_relative_to(edited_file.parent) else path), path, f.read(), path.parent))
+	return ret
+
+def parse_dep_file(path):
+	with open(path, 'rb') as f:
+		content = f.read().decode('utf-8')
+	content = content.replace('\\\n', ' ').replace('\\ ', '\0')
+	deps = []
+	for rule in content.splitlines():
+		_, sep, prerequisites = rule.partition(': ')
+		if sep:
+			deps.extend(item.replace('\0', ' ') for item in prerequisites.split())
+	return deps
+
+class ObjectCache:
+	'''Object files keyed by the compiler command and the source content. An entry also records
+	all headers the source included, so it is invalidated when any of them changes. Headers are
+	recorded by content hash, except for system headers, which are recorded by modification time and
+	size, so that a lookup does not have to read the whole standard library.
+
+	Builds hold a shared lock on the cache while they compile and link, and pruning takes the lock
+	exclusively, so that it never removes files that a build is about to use.'''
+
+	def __init__(self, cache_dir, max_entries, system_include_dirs):
+		self.cache_dir = Path(cache_dir)
+		self.max_entries = max_entries
+		self.system_include_dirs = tuple(system_include_dirs)
+		self.cache_dir.mkdir(parents = True, exist_ok = True)
+		self.lock_path = self.cache_dir / 'lock'
+
+	def object_key(self, source, flags):
+		return hash_bytes(' '.join(flags).encode('utf-8'), str(source.include_dir).encode('utf-8'),
+			source.content)
+
+	def object_path(self, key):
+		return self.cache_dir / (key + '.o')
+
+	def is_system_header(self, path):
+		return os.path.normpath(path).startswith(self.system_include_dirs)
+
+	def describe_dependency(self, path):
+		return file_stamp(path) if self.is_system_header(path) else hash_file(path)
+
+	def lookup_object(self, key):
+		try:
+			with open(self.cache_dir / (key + '.json'), 'rb') as f:
+				deps = json.load(f)
+		except (OSError, ValueError):
+			return None
+
+		object_path = self.object_path(key)
+		if not object_path.is_file():
+			return None
+
+		for dep, description in deps.items():
+			# Entries written before system headers were stamped only have hashes
+			current = file_stamp(dep) if isinstance(description, list) else hash_file(dep)
+			if current != description:
+				return None
+
+		os.utime(object_path)
+		return object_path
+
+	def store_object(self, key, object_file, dep_file, source_path):
+		deps = {dep: self.describe_dependency(dep) for dep in parse_dep_file(dep_file)
+			if Path(dep) != Path(source_path)}
+
+		# Write to temporary names first, so concurrent builds never see a partial entry
+		object_path = self.object_path(key)
+		tmp_suffix = '.%d.%d.tmp'%(os.getpid(), threading.get_ident())
+		with open(self.cache_dir / (key + '.json' + tmp_suffix), 'w') as f:
+			json.dump(deps, f)
+		shutil.copyfile(object_file, str(object_path) + tmp_suffix)
+		os.replace(str(object_path) + tmp_suffix, object_path)
+		os.replace(self.cache_dir / (key + '.json' + tmp_suffix), self.cache_dir / (key + '.json'))
+		return object_path
+
+	def executable_path(self, object_keys, link_flags):
+		return self.cache_dir / (hash_bytes(' '.join(link_flags).encode('utf-8'),
+			*[key.encode('utf-8') for key in object_keys]) + '.out')
+
+	def store_executable(self, exec_file, exec_path):
+		tmp_name = '%s.%d.%d.tmp'%(exec_path, os.getpid(), threading.get_ident())
+		shutil.copy(exec_file, tmp_name)
+		os.replace(tmp_name, exec_path)
+
+	def open_lock(self):
+		return open(self.lock_path, 'a')
+
+	def use(self):
+		'''Returns a context that keeps files in the cache from being pruned'''
+		return CacheLock(self.open_lock(), fcntl.LOCK_SH)
+
+	def prune(self):
+		'''Removes the least recently used entries beyond max_entries. Does nothing while another
+		build uses the cache, since the next build will prune anyway.'''
+		with self.open_lock() as lock_file:
+			try:
+				fcntl.flock(lock_file, fcntl.LOCK_EX | fcntl.LOCK_NB)
+			except BlockingIOError:
+				return
+
+			entries = sorted((item for item in self.cache_dir.iterdir()
+				if item.suffix in ['.o', '.out']), key = lambda item: item.stat().st_mtime)
+			for item in entries[:max(len(entries) - self.max_entries, 0)]:
+				item.unlink(missing_ok = True)
+				item.with_suffix('.json').unlink(missing_ok = True)
+
+class CacheLock:
+	def __init__(self, lock_file, operation):
+		self.lock_file = lock_file
+		fcntl.flock(lock_file, operation)
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		# Closing the file releases the lock
+		self.lock_file.close()
+
+def default_cache_dir():
+	cache_home = os.environ.get('XDG_CACHE_HOME', str(Path.home() / '.cache'))
+	return Path(cache_home) / 'pretty' / 'objects'
@@ -13,11 +13,55 @@ import html
 import signal
 import secrets
 import os
+import shutil
 import template_file
+import output_stream
+import shm_transport
+import output_store
+import resource_limits
+import cxx_project
+import records
 import mimetypes
+import codecs
+import io
+import argparse
+import concurrent.futures
 
 app_dir = Path(__file__).parents[1]
 
+# Size of the shared-memory ring used for application output when transport is 'shm'
+shm_ring_size = 1 << 22
+transport = 'pipe'
+
+# With 'records', the application sends values in the binary record format, and the server renders
+# them to HTML
+output_format = 'html'
+
+# If set, the raw output of every run is saved here, and can be rendered again with records.py
+record_dir = None
+
+# Application output is kept on disk. Only this much is sent to the browser directly, the rest is
+# loaded on demand
+output_window_size = 16 << 20
+max_inline_fragment = 1 << 20
+output_stores = output_store.OutputStores(4)
+
+# Applies to both the compiler and the application
+limits = resource_limits.Limits(wall_time = 60, cpu_time = 60, memory = 4096 << 20,
+	output_size = 1024 << 20, process_count = 256)
+
+cxx_flags = ['-std=c++20', '-O3', '-ffast-math', '-Wall', '-Wextra', '-Wconversion', '-Werror']
+object_cache_dir = cxx_project.default_cache_dir()
+object_cache_size = 512
+object_cache = None
+
+def get_object_cache():
+	global object_cache
+	if object_cache == None:
+		object_cache = cxx_project.ObjectCache(object_cache_dir, object_cache_size,
+			cxx_project.find_system_include_dirs('g++'))
+	return object_cache
+
 def escape_html(str):
 	return html.escape(str)
 
@@ -27,18 +71,39 @@ def write_text(str, output_stream):
 def print_delimiter(output_stream):
 	write_text('<hr>', output_stream)
 
-def make_error_msg(return_code):
+def make_error_msg(return_code, watchdog):
 	msg = ''
 	if return_code < 0:
-		msg = 'Process terminated by %s'%signal.strsignal(-return_code)
+		msg = 'Process terminated by %s (%s)'%(signal.strsignal(-return_code),
+			signal.Signals(-return_code).name)
 	else:
 		msg = 'Process terminated with exit status %d'%return_code
-	return '<p class="error">%s</p>'%msg
+
+	reason = watchdog.explain(return_code)
+	if reason != None:
+		msg = '%s. %s'%(msg, reason)
+	return '<p class="error">%s</p>'%escape_html(msg)
+
+def start_process(args, **kwargs):
+	return subprocess.Popen(resource_limits.limit_command(args, limits),
+		bufsize = 0,
+		stdin = subprocess.DEVNULL,
+		stderr = subprocess.STDOUT,
+		start_new_session = True,
+		**kwargs)
+
+def limit_output(dest, watchdog):
+	return resource_limits.LimitedStream(dest, limits.output_size,
+		lambda: watchdog.kill('Output size limit of %d MiB exceeded'%(limits.output_size >> 20)),
+		watchdog.scan_output)
 
 def pump_data_esc(src_fd, dest, buffer_size):
+	# Multi-byte characters may be split across reads, so decode incrementally
+	decoder = codecs.getincrementaldecoder('utf-8')(errors = 'replace')
 	while (buffer := os.read(src_fd, buffer_size)):
-		write_text(html.escape(buffer.decode('utf-8')), dest)
+		write_text(html.escape(decoder.decode(buffer)), dest)
 		dest.flush()
+	write_text(html.escape(decoder.decode(b'', final = True)), dest)
 
 def pump_data(src_fd, dest, buffer_size):
 	while (buffer := os.read(src_fd, buffer_size)):
@@ -48,62 +113,148 @@ def pump_data(src_fd, dest, buffer_size):
 def get_mime_from_path(src):
 	return mimetypes.guess_type(src)[0]
 
-def compile_single_src_cxx_file(src_file, orig_src_dir, exec_name, log_stream):
+def run_tool(args):
+	'''Runs args and returns the exit status together with its escaped output'''
+	output = io.BytesIO()
+	with start_process(args, stdout = subprocess.PIPE) as tool, \
+		resource_limits.Watchdog(tool, limits) as watchdog:
+		pump_data_esc(tool.stdout.fileno(), limit_output(output, watchdog), 65536)
+		return (tool.wait(), output.getvalue(), watchdog)
+
+def compile_object(source, temp_dir):
 	cxx_inc_dir = app_dir / 'lib' / 'cxx'
-	print(cxx_inc_dir)
-	with subprocess.Popen(['g++',
-		'-iquote%s'%orig_src_dir,
-		'-I%s'%cxx_inc_dir,
-		'-std=c++20',
-		'-O3',
-		'-ffast-math',
-		'-Wall',
-		'-Wextra',
-		'-Wconversion',
-		'-Werror',
-		src_file,
-		'-o',
-		exec_name],
-		bufsize = 0,
-		stdout = subprocess.PIPE,
-		stdin = subprocess.DEVNULL,
-		stderr = subprocess.STDOUT) as compiler:
-		write_text('''<h2>Compiler output</h2>''', log_stream)
-		log_stream.flush()
-		write_text('<pre>', log_stream)
-		pump_data_esc(compiler.stdout.fileno(), log_stream, 65536)
-		write_text('</pre>', log_stream)
-		log_stream.flush()
-		compiler.wait()
+	flags = ['-iquote%s'%source.include_dir, '-I%s'%cxx_inc_dir] + cxx_flags
+	cache = get_object_cache()
+	key = cache.object_key(source, flags)
+	object_path = cache.lookup_object(key)
+	if object_path != None:
+		return (0, b'', None, key, True)
+
+	object_file = temp_dir / (key + '.o')
+	dep_file = temp_dir / (key + '.d')
+	returncode, output, watchdog = run_tool(['g++'] + flags + ['-MD', '-MF', str(dep_file),
+		'-c', str(source.path), '-o', str(object_file)])
+	if returncode == 0:
+		cache.store_object(key, object_file, dep_file, source.path)
+	return (returncode, output, watchdog, key, False)
+
+def build_cxx_project(sources, temp_dir, log_stream):
+	'''Compiles all sources in parallel, reusing cached objects, and links them. Returns the path
+	to a copy of the executable in temp_dir, or None if the build failed.'''
+	write_text('''<h2>Compiler output</h2>''', log_stream)
+	log_stream.flush()
+	with get_object_cache().use():
+		return build_cxx_project_locked(sources, temp_dir, log_stream)
+
+def build_cxx_project_locked(sources, temp_dir, log_stream):
+	with concurrent.futures.ThreadPoolExecutor(max_workers = os.cpu_count()) as executor:
+		jobs = [executor.submit(compile_object, source, temp_dir) for source in sources]
+		results = []
+		for source, job in zip(sources, jobs):
+			returncode, output, watchdog, key, cached = job.result()
+			results.append(key)
+			if len(sources) > 1:
+				write_text('<h3>%s%s</h3>'%(escape_html(source.name),
+					' (cached)' if cached else ''), log_stream)
+			write_text('<pre>', log_stream)
+			log_stream.write(output)
+			write_text('</pre>', log_stream)
+			if returncode != 0:
+				write_text(make_error_msg(returncode, watchdog), log_stream)
+			log_stream.flush()
+
+	cache = get_object_cache()
+	if any(job.result()[0] != 0 for job in jobs):
 		print_delimiter(log_stream)
-		log_stream.flush()
-		if compiler.returncode != 0:
-			write_text(make_error_msg(compiler.returncode), log_stream)
-			return False
-		else:
-			write_text('<p>Program compiled successfully</p>', log_stream)
-			return True
+		return None
+
+	# Only link when some object has changed
+	exec_name = cache.executable_path(results, cxx_flags)
+	if not exec_name.is_file():
+		linked_file = temp_dir / 'src.out'
+		returncode, output, watchdog = run_tool(['g++'] + cxx_flags +
+			[str(cache.object_path(key)) for key in results] + ['-o', str(linked_file)])
+		if len(output) != 0:
+			write_text('<pre>', log_stream)
+			log_stream.write(output)
+			write_text('</pre>', log_stream)
+		if returncode != 0:
+			print_delimiter(log_stream)
+			write_text(make_error_msg(returncode, watchdog), log_stream)
+			return None
+		cache.store_executable(linked_file, exec_name)
+	else:
+		os.utime(exec_name)
+
+	# Run a private copy, so the cache entry may be pruned while the program runs
+	run_name = temp_dir / 'program.out'
+	try:
+		os.link(exec_name, run_name)
+	except OSError:
+		shutil.copy(exec_name, run_name)
+
+	print_delimiter(log_stream)
+	write_text('<p>Program compiled successfully</p>', log_stream)
+	return run_name
+
+def make_application_env():
+	env = dict(os.environ)
+	env['PRETTY_FRAGMENT_MARKERS'] = '1'
+	if output_format == 'records':
+		env['PRETTY_OUTPUT_FORMAT'] = 'records'
+	return env
 
 def run_executable(exec_name, log_stream):
-	with subprocess.Popen([exec_name], bufsize=0,
-		stdout=subprocess.PIPE,
-		stdin=subprocess.DEVNULL,
-		stderr=subprocess.STDOUT) as application:
-		write_text('''<h2>Application output</h2>\n''', log_stream)
-		log_stream.flush()
-		pump_data(application.stdout.fileno(), log_stream, 65536)
-		application.wait()
-		print_delimiter(log_stream)
-		log_stream.flush()
-		if application.returncode != 0:
-			write_text(make_error_msg(application.returncode), log_stream)
-			return False
+	write_text('''<h2>Application output</h2>\n''', log_stream)
+	log_stream.flush()
+	store = output_stores.create()
+	try:
+		dest = records.RecordDetector(output_store.FragmentingStream(log_stream, store,
+			output_window_size, max_inline_fragment))
+		if record_dir != None:
+			dest = records.SavingStream(dest, records.create_record_file(record_dir))
+		if transport == 'shm' and shm_transport.is_available():
+			with shm_transport.Ring(shm_ring_size) as ring:
+				returncode, watchdog = run_executable_with_ring(exec_name, ring, dest)
 		else:
-			write_text('<p>Program exited normally</p>\n', log_stream)
-			return True
+			returncode, watchdog = run_executable_with_pipe(exec_name, dest)
+		dest.close()
+	finally:
+		output_stores.finish_writing(store)
+	return report_exit_status(returncode, watchdog, log_stream)
+
+def run_executable_with_pipe(exec_name, dest):
+	with start_process([exec_name],
+		stdout = subprocess.PIPE,
+		env = make_application_env()) as application, \
+		resource_limits.Watchdog(application, limits) as watchdog:
+		pump_data(application.stdout.fileno(), limit_output(dest, watchdog), 65536)
+		return (application.wait(), watchdog)
+
+def run_executable_with_ring(exec_name, ring, dest):
+	with start_process([exec_name],
+		stdout = subprocess.PIPE,
+		pass_fds = ring.fds(),
+		env = ring.env(make_application_env())) as application, \
+		resource_limits.Watchdog(application, limits) as watchdog:
+		limited_dest = limit_output(dest, watchdog)
+		shm_transport.pump_data(application.stdout.fileno(), ring, limited_dest, 65536)
+		returncode = application.wait()
+		ring.drain(limited_dest)
+		return (returncode, watchdog)
+
+def report_exit_status(returncode, watchdog, log_stream):
+	print_delimiter(log_stream)
+	log_stream.flush()
+	if returncode != 0:
+		write_text(make_error_msg(returncode, watchdog), log_stream)
+		return False
+	else:
+		write_text('<p>Program exited normally</p>\n', log_stream)
+		return True
 
 
-def build_and_run(source_code, orig_src_dir, output_stream, api_key):
+def build_and_run(source_code, orig_src_file, output_stream, api_key):
 	write_text('''<!DOCTYPE html>
 <html lang="en">
 <head>
@@ -119,17 +270,16 @@ def build_and_run(source_code, orig_src_dir, output_stream, api_key):
 	write_text('''<h1>PreTTY output</h1>\n''', output_stream)
 	output_stream.flush()
 	with tempfile.TemporaryDirectory() as temp_dir:
-		src_file_name = temp_dir + '/src.cpp'
-		with open(src_file_name, 'wb') as src_file:
-			write_text(source_code, src_file)
-
-		exec_name = temp_dir + '/src.out'
-		if compile_single_src_cxx_file(src_file_name, orig_src_dir, exec_name, output_stream):
+		sources = cxx_project.collect_sources(orig_src_file, source_code.encode('utf-8'),
+			Path(temp_dir))
+		exec_name = build_cxx_project(sources, Path(temp_dir), output_stream)
+		if exec_name != None:
 			output_stream.flush()
 			print_delimiter(output_stream)
 			output_stream.flush()
 			run_executable(exec_name, output_stream)
 			output_stream.flush()
+		get_object_cache().prune()
 
 	write_text('''</body>
 </html>''', output_stream)
@@ -189,6 +339,24 @@ class HttpReqHandler(http.server.SimpleHTTPRequestHandler):
 				shutdown(self.port)
 				return
 
+			if path == '/fragments':
+				store = output_stores.get(params.get('store', ''))
+				content = None
+				if store != None:
+					try:
+						content = store.read_fragments(int(params['first']), int(params['last']))
+					except (KeyError, ValueError):
+						pass
+
+				if content == None:
+					write_text('%s 404 Not Found\r\n\r\n' % self.request_version, self.wfile)
+					return
+
+				write_text('%s 200\r\nContent-Type: text/html; charset=utf-8\r\n'
+					'Content-Length: %d\r\n\r\n' % (self.request_version, len(content)), self.wfile)
+				self.wfile.write(content)
+				return
+
 			if path == '/':
 				path = '/main_page.html'
 
@@ -239,17 +407,23 @@ class HttpReqHandler(http.server.SimpleHTTPRequestHandler):
 				return
 
 			if self.path == '/build_and_run':
-				write_text('%s 200\r\nContent-Type: text/html\r\n\r\n' %
-					self.request_version, self.wfile)
-				src_dir = '.'
+				# Chunked transfer encoding is only available from HTTP/1.1
+				chunked = self.request_version == 'HTTP/1.1'
+				content_encoding = output_stream.select_content_encoding(
+					self.headers.get('Accept-Encoding'))
+				write_text('%s 200\r\n%s\r\n' % (self.request_version,
+					output_stream.make_headers('text/html; charset=utf-8', content_encoding, chunked)),
+					self.wfile)
+				src_file = None
 				if 'filename' in parsed_data and len(parsed_data['filename'][0]) > 0:
 					print('Filename is %s'%parsed_data['filename'][0])
 					# HACK: There is currently no support for sessions on server side. Use a path
-					# provided by the client to set source file TemporaryDirectory
-					src_dir = Path(parsed_data['filename'][0]).parents[0]
+					# provided by the client to find the source directory, and the project the
+					# file belongs to
+					src_file = Path(parsed_data['filename'][0])
 
-				print('src_dir %s'%src_dir)
-				build_and_run(parsed_data['source'][0], src_dir, self.wfile, self.api_key)
+				with output_stream.OutputStream(self.wfile, content_encoding, chunked) as dest:
+					build_and_run(parsed_data['source'][0], src_file, dest, self.api_key)
 				return
 
 			self.wfile.write(('%s 400 Bad request %s\r\n' % (self.request_version, self.path)).encode('utf-8'))
@@ -257,7 +431,10 @@ class HttpReqHandler(http.server.SimpleHTTPRequestHandler):
 		except Exception as exc:
 			print(exc)
 
-def create_socket(listen_address, handler):
+def create_socket(listen_address, handler, port = None):
+	if port != None:
+		return (socketserver.TCPServer((listen_address, port), handler), port)
+
 	port = 65535
 	while True:
 		try:
@@ -269,11 +446,83 @@ def create_socket(listen_address, handler):
 			else:
 				port = 65535
 
+def parse_args():
+	parser = argparse.ArgumentParser(description = 'PreTTY Workbench server')
+	parser.add_argument('--port', type = int,
+		help = 'Port to listen on. By default, a free port between 49152 and 65535 is used')
+	parser.add_argument('--api-key', default = secrets.token_hex(),
+		help = 'Key that clients must present. By default, a random key is used')
+	parser.add_argument('--api-key-file',
+		help = 'File to read the key from. Unlike --api-key, this keeps the key off the command line')
+	parser.add_argument('--no-browser', action = 'store_true',
+		help = 'Do not open the workbench in a web browser')
+	parser.add_argument('--transport', choices = ['pipe', 'shm'], default = transport,
+		help = 'How application output is passed to the server. With shm, stdout and std::cout go '
+			'through a shared-memory ring, while stderr and direct writes to file descriptor 1 still '
+			'use the pipe, and are not ordered with respect to the ring')
+	parser.add_argument('--output-format', choices = ['html', 'records'], default = output_format,
+		help = 'Whether the application sends HTML, or values in a binary format that the server '
+			'renders')
+	parser.add_argument('--record-dir',
+		help = 'Directory where the raw output of every run is saved')
+	parser.add_argument('--output-window', type = int, default = output_window_size >> 20,
+		help = 'Amount of application output, in MiB, that is sent to the browser directly')
+	parser.add_argument('--max-inline-fragment', type = int, default = max_inline_fragment >> 20,
+		help = 'Fragments larger than this, in MiB, are only loaded on demand')
+	parser.add_argument('--wall-time', type = float, default = limits.wall_time,
+		help = 'Wall-clock time limit, in seconds, for the compiler and the application')
+	parser.add_argument('--cpu-time', type = int, default = limits.cpu_time,
+		help = 'CPU time limit, in seconds, for the compiler and the application')
+	parser.add_argument('--memory', type = int, default = limits.memory >> 20,
+		help = 'Address space limit, in MiB, for the compiler and the application')
+	parser.add_argument('--max-output', type = int, default = limits.output_size >> 20,
+		help = 'Output size limit, in MiB, for the compiler and the application')
+	parser.add_argument('--max-processes', type = int, default = limits.process_count,
+		help = 'Maximum number of processes and threads the compiler or the application may start')
+	parser.add_argument('--object-cache', default = str(object_cache_dir),
+		help = 'Directory where compiled object files are cached between builds')
+	parser.add_argument('--object-cache-size', type = int, default = object_cache_size,
+		help = 'Maximum number of object files and executables to keep in the cache')
+	return parser.parse_args()
+
 def run():
+	args = parse_args()
+	global transport
+	global output_format
+	global record_dir
+	global output_window_size
+	global max_inline_fragment
+	transport = args.transport
+	output_format = args.output_format
+	record_dir = args.record_dir
+	output_window_size = args.output_window << 20
+	max_inline_fragment = args.max_inline_fragment << 20
+
+	global object_cache_dir
+	global object_cache_size
+	object_cache_dir = args.object_cache
+	object_cache_size = args.object_cache_size
+
+	# Zero disables a limit
+	global limits
+	limits = resource_limits.Limits(
+		wall_time = args.wall_time if args.wall_time > 0 else None,
+		cpu_time = args.cpu_time if args.cpu_time > 0 else None,
+		memory = args.memory << 20 if args.memory > 0 else None,
+		output_size = args.max_output << 20 if args.max_output > 0 else None,
+		process_count = args.max_processes if args.max_processes > 0 else None)
+	if resource_limits.prlimit_path == None and (limits.cpu_time != None
+		or limits.memory != None or limits.process_count != None):
+		print('prlimit was not found. CPU time, memory and process limits are not enforced.')
+
 	handler = HttpReqHandler
-	server, port = create_socket('127.0.0.1', handler)
+	server, port = create_socket('127.0.0.1', handler, args.port)
 	handler.port = port
-	handler.api_key = secrets.token_hex()
+	handler.api_key = args.api_key
+	if args.api_key_file != None:
+		with open(args.api_key_file, 'rb') as f:
+			handler.api_key = f.read().decode('utf-8').strip()
+	print('Listening on port %d'%port, flush = True)
 
 	with tempfile.TemporaryDirectory() as temp_dir:
 		login_page = temp_dir + '/login.html'
@@ -282,18 +531,20 @@ def run():
 				{'port':handler.port, 'api_key': handler.api_key}), login_page_file)
 
 		with server as httpd:
-			browser = subprocess.run(['xdg-open', login_page])
+			returncode = 0
+			if not args.no_browser:
+				returncode = subprocess.run(['xdg-open', login_page]).returncode
 			global do_exit
 			while not do_exit:
 				sock = httpd.get_request()
 				if do_exit:
-					return browser.returncode
+					return returncode
 				if httpd.verify_request(sock[0], sock[1]) == False:
 					print("Invalid req")
 					continue
 
 				_thread.start_new_thread(httpd.process_request, (sock[0], sock[1]))
-			return browser.returncode
+			return returncode
 
 if __name__ == '__main__':
 	exit(run())
@@ -0,0 +1,235 @@
+#!/usr/bin/env python3
+
+import os
+import re
+import tempfile
+import secrets
+import threading
+
+# Must match the markers written by atomic_write in lib/cxx/pretty/base_impl.hpp
+fragment_begin_marker = b'<!--pretty:fragment-->'
+fragment_end_marker = b'<!--/pretty:fragment-->'
+fragment_markers = [re.compile(re.escape(fragment_begin_marker)),
+	re.compile(re.escape(fragment_end_marker))]
+
+# Must match live_slot::update in lib/cxx/pretty/live.hpp
+live_update_prefix = b'<template data-live-target="'
+
+class OutputStore:
+	def __init__(self):
+		self.id = secrets.token_hex(8)
+		self.file = tempfile.TemporaryFile()
+		self.size = 0
+		self.fragments = []
+		# Set while a run writes to the store. The store is not closed before the run is done.
+		self.writing = True
+
+	def close(self):
+		self.file.close()
+
+	def append(self, buffer):
+		os.write(self.file.fileno(), buffer)
+		self.size += len(buffer)
+
+	def add_fragment(self, offset, size):
+		self.fragments.append((offset, size))
+		return len(self.fragments) - 1
+
+	def read_fragments(self, first, last):
+		if first < 0 or last > len(self.fragments) or first >= last:
+			return None
+		begin = self.fragments[first][0]
+		end = self.fragments[last - 1][0] + self.fragments[last - 1][1]
+		return os.pread(self.file.fileno(), end - begin, begin)
+
+class OutputStores:
+	def __init__(self, max_count):
+		self.max_count = max_count
+		self.stores = []
+		self.lock = threading.Lock()
+
+	def create(self):
+		store = OutputStore()
+		with self.lock:
+			self.stores.append(store)
+			self.evict()
+		return store
+
+	def finish_writing(self, store):
+		with self.lock:
+			store.writing = False
+			self.evict()
+
+	def evict(self):
+		# Close the oldest stores that are no longer written to. Stores of running programs are
+		# kept, even if that means keeping more than max_count for a while.
+		while len(self.stores) > self.max_count:
+			oldest = next((store for store in self.stores if not store.writing), None)
+			if oldest == None:
+				break
+			self.stores.remove(oldest)
+			oldest.close()
+
+	def get(self, id):
+		with self.lock:
+			for store in self.stores:
+				if store.id == id:
+					return store
+		return None
+
+class FragmentingStream:
+	'''Splits application output at fragment markers. Everything goes into the store, while only a
+	bounded window is forwarded to dest. Output that does not fit is replaced by placeholders.
+	Live updates replace content that is already on the page, so they are always forwarded, and do
+	not use up the window.'''
+
+	def __init__(self, dest, store, window_size, max_inline_fragment):
+		self.dest = dest
+		self.store = store
+		self.window_left = window_size
+		self.max_inline_fragment = max_inline_fragment
+		# A possibly incomplete marker at the end of the previous write
+		self.carry = b''
+		self.in_fragment = False
+		self.fragment_offset = 0
+		self.fragment_buffer = bytearray()
+		self.fragment_spilled = False
+		self.fragment_is_live = None
+		# Start of output outside fragments that did not fit in the window
+		self.plain_offset = None
+		self.placeholder_range = None
+
+	def write(self, buffer):
+		# Buffers are scanned in place, so that views handed over by the transport are not copied
+		if len(self.carry) != 0:
+			buffer = self.carry + bytes(buffer)
+			self.carry = b''
+		buffer = memoryview(buffer)
+		pos = 0
+		while True:
+			marker = fragment_end_marker if self.in_fragment else fragment_begin_marker
+			match = fragment_markers[self.in_fragment].search(buffer, pos)
+			if match == None:
+				keep = next((k for k in range(len(marker) - 1, 0, -1)
+					if len(buffer) - pos >= k and buffer[len(buffer) - k:] == marker[:k]), 0)
+				self.consume(buffer[pos:len(buffer) - keep])
+				self.carry = bytes(buffer[len(buffer) - keep:])
+				return
+
+			self.consume(buffer[pos:match.start()])
+			pos = match.end()
+			if self.in_fragment:
+				self.end_fragment()
+			else:
+				self.begin_fragment()
+
+	def flush(self):
+		self.dest.flush()
+
+	def close(self):
+		self.consume(memoryview(self.carry))
+		self.carry = b''
+		if self.in_fragment:
+			self.end_fragment()
+		self.end_plain_output()
+		self.emit_placeholder()
+		self.dest.flush()
+
+	def consume(self, buffer):
+		if len(buffer) == 0:
+			return
+
+		self.store.append(buffer)
+		if not self.in_fragment:
+			self.consume_plain_output(buffer)
+			return
+
+		if self.fragment_spilled:
+			return
+
+		self.fragment_buffer += buffer
+		if self.fragment_is_live == None and len(self.fragment_buffer) >= len(live_update_prefix):
+			self.fragment_is_live = self.fragment_buffer.startswith(live_update_prefix)
+		if self.fragment_is_live == False and not self.fits_in_window(len(self.fragment_buffer)):
+			self.fragment_spilled = True
+			self.fragment_buffer = bytearray()
+
+	def fits_in_window(self, size):
+		return size <= min(self.max_inline_fragment, self.window_left)
+
+	def consume_plain_output(self, buffer):
+		if self.plain_offset == None:
+			forwarded = min(len(buffer), self.window_left)
+			if forwarded != 0:
+				self.emit_placeholder()
+				self.window_left -= forwarded
+				self.dest.write(buffer[:forwarded])
+			if forwarded == len(buffer):
+				return
+			# The rest goes to the store only, where it is loaded from like a fragment
+			self.plain_offset = self.store.size - (len(buffer) - forwarded)
+
+	def end_plain_output(self):
+		if self.plain_offset == None:
+			return
+
+		index = self.store.add_fragment(self.plain_offset, self.store.size - self.plain_offset)
+		self.plain_offset = None
+		self.add_to_placeholder(index)
+
+	def begin_fragment(self):
+		self.end_plain_output()
+		self.in_fragment = True
+		self.fragment_offset = self.store.size
+		self.fragment_buffer = bytearray()
+		self.fragment_spilled = False
+		self.fragment_is_live = None
+
+	def end_fragment(self):
+		self.in_fragment = False
+		index = self.store.add_fragment(self.fragment_offset, self.store.size - self.fragment_offset)
+		buffer = self.fragment_buffer
+		self.fragment_buffer = bytearray()
+		if not self.fragment_spilled and buffer.startswith(live_update_prefix):
+			self.dest.write(buffer)
+			return
+
+		if not self.fragment_spilled and self.fits_in_window(len(buffer)):
+			self.emit_placeholder()
+			self.window_left -= len(buffer)
+			self.dest.write(buffer)
+			return
+
+		self.add_to_placeholder(index)
+
+	def add_to_placeholder(self, index):
+		if self.placeholder_range == None:
+			self.placeholder_range = [index, index + 1]
+		else:
+			self.placeholder_range[1] = index + 1
+
+		# Once the window is exhausted, consecutive fragments share a placeholder up to a limit
+		first, last = self.placeholder_range
+		if self.store.fragments[last - 1][0] + self.store.fragments[last - 1][1] \
+			- self.store.fragments[first][0] >= self.max_inline_fragment:
+			self.emit_placeholder()
+
+	def emit_placeholder(self):
+		if self.placeholder_range == None:
+			return
+
+		first, last = self.placeholder_range
+		self.placeholder_range = None
+		size = self.store.fragments[last - 1][0] + self.store.fragments[last - 1][1] \
+			- self.store.fragments[first][0]
+		self.dest.write(('<div class="fragment_placeholder" data-store="%s" data-first="%d" '
+			'data-last="%d"><button onclick="load_fragments(this.parentNode)">Load %s (%d %s)'
+			'</button></div>\n'%(self.store.id, first, last, format_size(size),
+			last - first, 'fragment' if last - first == 1 else 'fragments')).encode('utf-8'))
+
+def format_size(size):
+	for unit in ['bytes', 'KiB', 'MiB']:
+		if size < 1024:
+			return '%d %s'%(size, unit) if unit == 'bytes' else '%.1f %s'%(size, unit)
+		size /= 1024
+	return '%.1f GiB'%size
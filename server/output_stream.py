@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+
+import zlib
+
+class PlainStream:
+	def __init__(self, dest):
+		self.dest = dest
+
+	def write(self, buffer):
+		self.dest.write(buffer)
+
+	def flush(self):
+		self.dest.flush()
+
+	def close(self):
+		self.dest.flush()
+
+class ChunkedStream:
+	def __init__(self, dest):
+		self.dest = dest
+
+	def write(self, buffer):
+		if len(buffer) == 0:
+			return
+		self.dest.write(b'%x\r\n' % len(buffer))
+		self.dest.write(buffer)
+		self.dest.write(b'\r\n')
+
+	def flush(self):
+		self.dest.flush()
+
+	def close(self):
+		self.dest.write(b'0\r\n\r\n')
+		self.dest.flush()
+
+class CompressedStream:
+	def __init__(self, dest, wbits):
+		self.dest = dest
+		self.compressor = zlib.compressobj(6, zlib.DEFLATED, wbits)
+
+	def write(self, buffer):
+		self.dest.write(self.compressor.compress(buffer))
+
+	def flush(self):
+		# Use a sync flush so the browser can render what has been written so far
+		self.dest.write(self.compressor.flush(zlib.Z_SYNC_FLUSH))
+		self.dest.flush()
+
+	def close(self):
+		self.dest.write(self.compressor.flush(zlib.Z_FINISH))
+		self.dest.close()
+
+supported_encodings = {'gzip': 16 + zlib.MAX_WBITS, 'deflate': zlib.MAX_WBITS}
+
+def select_content_encoding(accept_encoding):
+	if accept_encoding == None:
+		return None
+
+	accepted = {}
+	for item in accept_encoding.split(','):
+		fields = item.strip().split(';')
+		quality = 1.0
+		for param in fields[1:]:
+			param = param.strip()
+			if param.startswith('q='):
+				try:
+					quality = float(param[2:])
+				except ValueError:
+					quality = 0.0
+		accepted[fields[0].strip().lower()] = quality
+
+	for encoding in supported_encodings:
+		if accepted.get(encoding, 0.0) > 0.0:
+			return encoding
+	return None
+
+class OutputStream:
+	def __init__(self, dest, content_encoding, chunked):
+		self.stream = ChunkedStream(dest) if chunked else PlainStream(dest)
+		if content_encoding != None:
+			self.stream = CompressedStream(self.stream, supported_encodings[content_encoding])
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		self.stream.close()
+
+	def write(self, buffer):
+		self.stream.write(buffer)
+
+	def flush(self):
+		self.stream.flush()
+
+def make_headers(content_type, content_encoding, chunked):
+	headers = 'Content-Type: %s\r\nConnection: close\r\n'%content_type
+	if chunked:
+		headers += 'Transfer-Encoding: chunked\r\n'
+	if content_encoding != None:
+		headers += 'Content-Encoding: %s\r\n'%content_encoding
+	return headers
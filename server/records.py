@@ -0,0 +1,430 @@
+#!/usr/bin/env python3
+
+'''Renders application output that uses the record format to HTML. The input can be a file saved by
+the server with --record-dir, so that output can be viewed again without running the program.'''
+
+import argparse
+import datetime
+import decimal
+import functools
+import itertools
+import math
+import operator
+import os
+import re
+import struct
+import sys
+from pathlib import Path
+
+# Must match the record format in lib/cxx/pretty/base_impl.hpp
+record_marker = b'\x1ePR'
+record_format_version = 1
+
+token_end = 0x00
+token_signed_int = 0x01
+token_unsigned_int = 0x02
+token_float32 = 0x03
+token_float64 = 0x04
+token_text = 0x05
+token_html = 0x06
+token_byte = 0x07
+token_pointer = 0x08
+token_point = 0x09
+token_markup = 0x40
+
+markup_text = [
+	b'<ol start="0" class="tuple_content">\n',
+	b'<ol start="0" class="range_content">\n',
+	b'<ol class="range_content" start="0">\n',
+	b'</ol>\n',
+	b'<table class="tuple_content">\n',
+	b'<table class="range_content">\n',
+	b'<table>\n',
+	b'<table class="single_row">\n',
+	b'</table>\n',
+	b'<tr>\n',
+	b'</tr>\n',
+	b'<li>',
+	b'</li>',
+	b'<td>',
+	b'</td>',
+	b'<span class="empty">(no value)</span>\n'
+]
+markup_strings = [item.decode('utf-8') for item in markup_text]
+
+# Frames mostly consist of markup and numbers. Runs of these tokens are rendered in one go, since
+# looking at one token at a time costs more than formatting it.
+number_token_pattern = rb'[\x01\x02\x08][\x80-\xff]{0,9}[\x00-\x7f]|\x03[\x00-\xff]{4}|\x04[\x00-\xff]{8}' \
+	rb'|\x07[\x00-\xff]|\x09[\x00-\xff]{16}'
+number_token = re.compile(b'(' + number_token_pattern + b')')
+markup_and_number_run = re.compile(b'(?:[\x40-\x4f]|' + number_token_pattern + b')+')
+record_marker_pattern = re.compile(re.escape(record_marker))
+
+unpack_float32 = struct.Struct('<f').unpack_from
+unpack_float64 = struct.Struct('<d').unpack_from
+unpack_point = struct.Struct('<dd').unpack_from
+# Runs of one of these tokens are converted a column at a time
+float_columns = {token_float64: struct.Struct('<xd'), token_point: struct.Struct('<xdd')}
+
+# Must match write_as_html(char)
+html_escapes = [(b'&', b'&'), (b'<', b'<'), (b'>', b'>'), (b'"', b'&quot;')]
+
+class RecordError(Exception):
+	pass
+
+def shortest_digits(x, is_float32):
+	'''Returns the shortest decimal that reads back as x'''
+	if not is_float32:
+		return decimal.Decimal(repr(x))
+
+	for precision in range(1, 10):
+		text = '%.*e'%(precision - 1, x)
+		if struct.unpack('<f', struct.pack('<f', float(text)))[0] == x:
+			return decimal.Decimal(text)
+	return decimal.Decimal(repr(x))
+
+def format_float(x, is_float32 = False):
+	'''Formats x like std::to_chars without a format, which picks the shorter of fixed and
+	scientific notation'''
+	if not is_float32:
+		text = repr(x)
+		if 'e' not in text and 1e-3 <= abs(x) < 2.0**53:
+			# repr already picks fixed notation for these, and fixed is never longer than scientific
+			if not text.endswith('.0'):
+				return text
+
+			# Integers are written exactly, unless scientific notation is shorter
+			fixed = text[:-2]
+			digits = fixed.lstrip('-').rstrip('0')
+			if len(fixed.lstrip('-')) <= len(digits) + (len(digits) > 1) + 4:
+				return fixed
+
+	if math.isnan(x):
+		return '-nan' if math.copysign(1.0, x) < 0 else 'nan'
+	if math.isinf(x):
+		return '-inf' if x < 0 else 'inf'
+
+	sign, digits, exponent = shortest_digits(x, is_float32).as_tuple()
+	sign = '-' if sign else ''
+	digits = ''.join(str(digit) for digit in digits)
+	exponent += len(digits) - len(digits.rstrip('0'))
+	digits = digits.rstrip('0')
+	if len(digits) == 0:
+		return sign + '0'
+
+	point_pos = exponent + len(digits)
+	if exponent >= 0:
+		# Integers are written exactly, rather than padded with zeros
+		fixed = str(abs(int(x)))
+	elif point_pos > 0:
+		fixed = digits[:point_pos] + '.' + digits[point_pos:]
+	else:
+		fixed = '0.' + '0'*(-point_pos) + digits
+
+	sci_exponent = point_pos - 1
+	scientific = digits[0] + ('.' + digits[1:] if len(digits) > 1 else '') + \
+		'e%s%02d'%('+' if sci_exponent >= 0 else '-', abs(sci_exponent))
+	return sign + (fixed if len(fixed) <= len(scientific) else scientific)
+
+def read_varint(data, pos):
+	ret = 0
+	shift = 0
+	while pos < len(data):
+		byte = data[pos]
+		pos += 1
+		ret |= (byte & 0x7f) << shift
+		if byte < 0x80:
+			return (ret, pos)
+		shift += 7
+		if shift > 63:
+			raise RecordError('Invalid varint')
+	return None
+
+def format_floats(values):
+	'''Formats doubles like format_float, but faster when there are many'''
+	# Most values are in the range where repr already gives the right text. This is the same test
+	# as in format_float, only done on the text.
+	return [text if 'e' not in text and 'n' not in text and not text.endswith('.0')
+		and not text.startswith(('0.000', '-0.000')) else format_float(x)
+		for x, text in zip(values, map(repr, values))]
+
+@functools.lru_cache(maxsize = 4096)
+def render_markup(tokens):
+	return ''.join(markup_strings[token - token_markup] for token in tokens)
+
+@functools.lru_cache(maxsize = 4096)
+def render_markup_bytes(tokens):
+	return b''.join(markup_text[token - token_markup] for token in tokens)
+
+def render_number(token):
+	kind = token[0]
+	if kind == token_float64:
+		return format_float(unpack_float64(token, 1)[0])
+	if kind == token_float32:
+		return format_float(unpack_float32(token, 1)[0], True)
+	if kind == token_point:
+		x, y = unpack_point(token, 1)
+		return '%s,%s '%(format_float(x), format_float(y))
+	if kind == token_byte:
+		return '<code class="byte">%02x</code>'%token[1]
+
+	value = token[1] if len(token) == 2 else read_varint(token, 1)[0]
+	if kind == token_signed_int:
+		return str((value >> 1) ^ -(value & 1))
+	if kind == token_unsigned_int:
+		return str(value)
+	return '<code class="pointer">%s</code>'%('0x%x'%value if value != 0 else '(nil)')
+
+def render_run(run):
+	'''Renders a run of markup and number tokens'''
+	# Splitting at numbers leaves the markup between them
+	parts = number_token.split(run)
+	if len(parts) == 1:
+		return render_markup_bytes(run)
+
+	parts[0::2] = map(render_markup, parts[0::2])
+	numbers = parts[1::2]
+	kind = numbers[0][0]
+	if len(numbers) >= 16 and kind in float_columns \
+		and bytes(map(operator.itemgetter(0), numbers)).count(kind) == len(numbers):
+		texts = format_floats(list(itertools.chain.from_iterable(
+			float_columns[kind].iter_unpack(b''.join(numbers)))))
+		parts[1::2] = texts if kind == token_float64 \
+			else map('{},{} '.format, texts[0::2], texts[1::2])
+	else:
+		parts[1::2] = map(render_number, numbers)
+	return ''.join(parts).encode('utf-8')
+
+class RecordRenderer:
+	'''Renders record frames in application output to HTML. Everything outside a frame is already
+	HTML, and is forwarded unchanged.'''
+
+	def __init__(self, dest):
+		self.dest = dest
+		self.pending = b''
+		self.in_frame = False
+		# After an invalid record, the rest of the frame cannot be told apart from HTML, so
+		# everything up to the next frame is dropped
+		self.skipping = False
+
+	def write(self, buffer):
+		data = self.pending + bytes(buffer)
+		output = []
+		pos = 0
+		while pos < len(data):
+			if not self.in_frame:
+				index = data.find(record_marker, pos)
+				if index == -1:
+					# Keep a possibly incomplete marker for the next write
+					keep = incomplete_marker_size(data)
+					if not self.skipping:
+						output.append(data[pos:len(data) - keep])
+					pos = len(data) - keep
+					break
+
+				if not self.skipping:
+					output.append(data[pos:index])
+				if index + len(record_marker) >= len(data):
+					pos = index
+					break
+
+				self.skipping = False
+
+				version = data[index + len(record_marker)]
+				pos = index + len(record_marker) + 1
+				if version != record_format_version:
+					output.append(b'<p class="error">Output uses record format version %d, '
+						b'which is not supported</p>\n'%version)
+					continue
+				self.in_frame = True
+				continue
+
+			if data[pos] not in (token_end, token_text, token_html):
+				run = markup_and_number_run.match(data, pos)
+				if run != None:
+					output.append(render_run(run.group()))
+					pos = run.end()
+					continue
+
+			try:
+				next_pos = self.render_token(data, pos, output)
+			except (RecordError, IndexError) as exc:
+				output.append(b'<p class="error">Invalid record: %s</p>\n'%str(exc).encode('utf-8'))
+				self.in_frame = False
+				self.skipping = True
+				next_pos = pos + 1
+
+			if next_pos == None:
+				break
+			pos = next_pos
+
+		self.pending = data[pos:]
+		if len(output) != 0:
+			self.dest.write(b''.join(output))
+
+	def flush(self):
+		self.dest.flush()
+
+	def close(self):
+		if self.in_frame:
+			self.dest.write(b'<p class="error">Output ended inside a record</p>\n')
+		elif len(self.pending) != 0 and not self.skipping:
+			self.dest.write(self.pending)
+		self.pending = b''
+		self.in_frame = False
+		self.skipping = False
+		self.dest.close()
+
+	def render_token(self, data, pos, output):
+		'''Appends the HTML for the token at pos to output, and returns the position of the next
+		token. Returns None if the token is incomplete. Markup and numbers are only seen here if
+		they are invalid or incomplete, since render_run takes the complete ones.'''
+		token = data[pos]
+		pos += 1
+		if token >= token_markup:
+			raise RecordError('Unknown markup %d'%token)
+
+		if token == token_end:
+			self.in_frame = False
+			return pos
+
+		if token in (token_signed_int, token_unsigned_int, token_pointer):
+			# Raises if the varint is too long
+			read_varint(data, pos)
+			return None
+
+		if token in (token_float32, token_float64, token_point, token_byte):
+			return None
+
+		if token in (token_text, token_html):
+			result = read_varint(data, pos)
+			if result == None:
+				return None
+			size, pos = result
+			if pos + size > len(data):
+				return None
+			content = data[pos:pos + size]
+			if token == token_text:
+				for char, escaped in html_escapes:
+					content = content.replace(char, escaped)
+			output.append(content)
+			return pos + size
+
+		raise RecordError('Unknown token %d'%token)
+
+def incomplete_marker_size(data):
+	'''Returns the size of the record marker prefix that data ends with'''
+	return next((k for k in range(len(record_marker) - 1, 0, -1)
+		if data.endswith(record_marker[:k])), 0)
+
+class RecordDetector:
+	'''Forwards output to dest unchanged, until the first record frame starts. From there on, it is
+	passed through a RecordRenderer. Output that does not use records is neither copied nor
+	parsed.'''
+
+	def __init__(self, dest):
+		self.dest = dest
+		self.renderer = None
+		# A possibly incomplete marker at the end of the last write
+		self.held = b''
+
+	def write(self, buffer):
+		if self.renderer != None:
+			self.renderer.write(buffer)
+			return
+
+		if len(self.held) != 0 or len(buffer) < len(record_marker):
+			buffer = self.held + bytes(buffer)
+			self.held = b''
+
+		match = record_marker_pattern.search(buffer)
+		if match != None:
+			if match.start() != 0:
+				self.dest.write(buffer[:match.start()])
+			self.renderer = RecordRenderer(self.dest)
+			self.renderer.write(buffer[match.start():])
+			return
+
+		keep = incomplete_marker_size(bytes(buffer[len(buffer) - len(record_marker) + 1:]))
+		if keep != 0:
+			self.held = bytes(buffer[len(buffer) - keep:])
+			buffer = buffer[:len(buffer) - keep]
+		if len(buffer) != 0:
+			self.dest.write(buffer)
+
+	def flush(self):
+		self.dest.flush()
+
+	def close(self):
+		if self.renderer != None:
+			self.renderer.close()
+			return
+
+		if len(self.held) != 0:
+			self.dest.write(self.held)
+		self.dest.close()
+
+class SavingStream:
+	'''Writes everything to file, as well as to dest'''
+
+	def __init__(self, dest, file):
+		self.dest = dest
+		self.file = file
+
+	def write(self, buffer):
+		self.file.write(buffer)
+		self.dest.write(buffer)
+
+	def flush(self):
+		self.file.flush()
+		self.dest.flush()
+
+	def close(self):
+		self.file.close()
+		self.dest.close()
+
+def create_record_file(record_dir):
+	record_dir = Path(record_dir)
+	record_dir.mkdir(parents = True, exist_ok = True)
+	name = '%s-%d.pretty'%(datetime.datetime.now().strftime('%Y%m%d-%H%M%S-%f'), os.getpid())
+	return open(record_dir / name, 'wb')
+
+class FileStream:
+	def __init__(self, file):
+		self.file = file
+
+	def write(self, buffer):
+		self.file.write(buffer)
+
+	def flush(self):
+		self.file.flush()
+
+	def close(self):
+		self.file.flush()
+
+def main():
+	parser = argparse.ArgumentParser(description = __doc__)
+	parser.add_argument('input', help = 'Saved application output')
+	parser.add_argument('--output', help = 'Where to write the HTML page. Defaults to stdout.')
+	args = parser.parse_args()
+
+	app_dir = Path(__file__).parents[1]
+	with open(app_dir / 'client' / 'document.css', 'rb') as f:
+		style = f.read()
+
+	dest_file = open(args.output, 'wb') if args.output != None else sys.stdout.buffer
+	dest = FileStream(dest_file)
+	dest.write(b'<!DOCTYPE html>\n<html lang="en">\n<head>\n<meta charset="UTF-8">\n'
+		b'<style>\n%s</style>\n</head>\n<body>\n'%style)
+	renderer = RecordRenderer(dest)
+	with open(args.input, 'rb') as f:
+		while (buffer := f.read(65536)):
+			renderer.write(buffer)
+	renderer.close()
+	dest.write(b'</body>\n</html>\n')
+	dest.close()
+	if dest_file != sys.stdout.buffer:
+		dest_file.close()
+
+if __name__ == '__main__':
+	main()
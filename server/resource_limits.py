@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+
+import os
+import re
+import signal
+import shutil
+import threading
+
+class Limits:
+	def __init__(self, wall_time, cpu_time, memory, output_size, process_count):
+		# Times are in seconds, sizes in bytes. None means unlimited.
+		self.wall_time = wall_time
+		self.cpu_time = cpu_time
+		self.memory = memory
+		self.output_size = output_size
+		# Linux counts threads as well as processes towards this limit
+		self.process_count = process_count
+
+def count_user_tasks():
+	'''Returns the number of threads that belong to the current user, in all processes'''
+	uid = os.getuid()
+	count = 0
+	for entry in os.scandir('/proc'):
+		if entry.name.isdigit():
+			try:
+				if entry.stat().st_uid == uid:
+					# The link count of the task directory is two plus the number of threads
+					count += max(os.stat(os.path.join(entry.path, 'task')).st_nlink - 2, 1)
+			except OSError:
+				pass
+	return count
+
+prlimit_path = shutil.which('prlimit')
+
+def limit_command(args, limits):
+	'''Returns a command that runs args with limits applied. prlimit sets the limits and then
+	executes args, so no Python code has to run in the forked child, which is not safe while the
+	server has other threads.'''
+	if prlimit_path == None:
+		return args
+
+	ret = [prlimit_path, '--core=0']
+	if limits.cpu_time != None:
+		# Send SIGXCPU at the soft limit, and SIGKILL one second later
+		ret.append('--cpu=%d:%d'%(limits.cpu_time, limits.cpu_time + 1))
+	if limits.memory != None:
+		ret.append('--as=%d'%limits.memory)
+	if limits.process_count != None and os.path.isdir('/proc'):
+		# RLIMIT_NPROC applies to all tasks of the user, so the limit must be relative to what is
+		# already running
+		ret.append('--nproc=%d'%(count_user_tasks() + limits.process_count))
+	return ret + ['--'] + list(args)
+
+class Watchdog:
+	'''Kills the process group of process when a limit is hit, and remembers why'''
+
+	def __init__(self, process, limits):
+		self.process = process
+		self.limits = limits
+		self.reason = None
+		self.allocation_failed = False
+		self.output_tail = b''
+		self.lock = threading.Lock()
+		self.timer = None
+		if limits.wall_time != None:
+			self.timer = threading.Timer(limits.wall_time, self.kill,
+				('Wall-clock time limit of %g s exceeded'%limits.wall_time,))
+			self.timer.daemon = True
+			self.timer.start()
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		if self.timer != None:
+			self.timer.cancel()
+
+	def kill(self, reason):
+		with self.lock:
+			if self.reason != None or self.process.poll() != None:
+				return
+			self.reason = reason
+			try:
+				os.killpg(self.process.pid, signal.SIGKILL)
+			except ProcessLookupError:
+				pass
+
+	def scan_output(self, buffer):
+		'''Looks for messages about failed allocations in the output of the process'''
+		if self.allocation_failed or len(buffer) == 0:
+			return
+		# Also look at where the previous buffer ended, in case a message is split between them
+		if allocation_failure_pattern.search(self.output_tail + bytes(buffer[:64])) != None \
+			or allocation_failure_pattern.search(buffer) != None:
+			self.allocation_failed = True
+		self.output_tail = bytes(buffer[-64:])
+
+	def explain(self, return_code):
+		'''Returns a description of the limit that terminated the process, if any'''
+		if self.reason != None:
+			return self.reason
+		if return_code == -signal.SIGXCPU:
+			return 'CPU time is limited to %g s'%self.limits.cpu_time
+		if return_code in (-signal.SIGKILL, -signal.SIGABRT) and self.allocation_failed \
+			and self.limits.memory != None:
+			return 'The process ran out of memory. Address space is limited to %d MiB'%(
+				self.limits.memory >> 20)
+		return None
+
+# Printed by the C++ runtime, glibc and the compiler when memory runs out
+allocation_failure_pattern = re.compile(
+	rb'std::bad_alloc|Cannot allocate memory|out of memory|memory exhausted')
+
+class LimitedStream:
+	'''Forwards at most max_size bytes to dest, and calls on_exceeded when more is written. Every
+	buffer is also passed to observe.'''
+
+	def __init__(self, dest, max_size, on_exceeded, observe):
+		self.dest = dest
+		self.bytes_left = max_size
+		self.on_exceeded = on_exceeded
+		self.observe = observe
+
+	def write(self, buffer):
+		self.observe(buffer)
+		if self.bytes_left == None:
+			self.dest.write(buffer)
+			return
+
+		if self.bytes_left <= 0:
+			return
+
+		if len(buffer) > self.bytes_left:
+			self.dest.write(buffer[:self.bytes_left])
+			self.bytes_left = 0
+			self.on_exceeded()
+			return
+
+		self.bytes_left -= len(buffer)
+		self.dest.write(buffer)
+
+	def flush(self):
+		self.dest.flush()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+
+import os
+import mmap
+import struct
+import select
+
+# Layout of the shared ring. Must match lib/cxx/pretty/shm_transport.hpp
+write_pos_offset = 0
+read_pos_offset = 64
+reader_waiting_offset = 128
+writer_waiting_offset = 192
+data_offset = 256
+
+# Python cannot issue a memory fence, so a doorbell may be missed when the ring becomes non-empty
+# just as the reader goes to sleep. This bounds the delay in that case.
+wait_timeout = 0.01
+
+def is_available():
+	return hasattr(os, 'memfd_create') and hasattr(os, 'eventfd')
+
+class Ring:
+	def __init__(self, capacity):
+		self.capacity = capacity
+		self.shm_fd = os.memfd_create('pretty_output', 0)
+		os.ftruncate(self.shm_fd, data_offset + capacity)
+		self.data_ready_fd = os.eventfd(0)
+		self.space_ready_fd = os.eventfd(0)
+		self.mem = mmap.mmap(self.shm_fd, data_offset + capacity)
+		self.view = memoryview(self.mem)
+		self.read_pos = 0
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, *args):
+		self.view.release()
+		self.mem.close()
+		os.close(self.shm_fd)
+		os.close(self.data_ready_fd)
+		os.close(self.space_ready_fd)
+
+	def fds(self):
+		return (self.shm_fd, self.data_ready_fd, self.space_ready_fd)
+
+	def env(self, env):
+		env = dict(env)
+		env['PRETTY_SHM_FD'] = str(self.shm_fd)
+		env['PRETTY_SHM_DATA_READY_FD'] = str(self.data_ready_fd)
+		env['PRETTY_SHM_SPACE_READY_FD'] = str(self.space_ready_fd)
+		return env
+
+	def has_data(self):
+		return struct.unpack_from('=Q', self.mem, write_pos_offset)[0] != self.read_pos
+
+	def set_reader_waiting(self, waiting):
+		struct.pack_into('=I', self.mem, reader_waiting_offset, 1 if waiting else 0)
+
+	def drain(self, dest):
+		'''Writes everything in the ring to dest. Returns False if the ring was empty.'''
+		write_pos = struct.unpack_from('=Q', self.mem, write_pos_offset)[0]
+		if write_pos == self.read_pos:
+			return False
+
+		while self.read_pos != write_pos:
+			begin = self.read_pos % self.capacity
+			end = min(begin + (write_pos - self.read_pos), self.capacity)
+			# Hand out a view into the ring so the data is not copied into Python bytes first
+			dest.write(self.view[data_offset + begin : data_offset + end])
+			self.read_pos += end - begin
+
+		struct.pack_into('=Q', self.mem, read_pos_offset, self.read_pos)
+		if struct.unpack_from('=I', self.mem, writer_waiting_offset)[0] != 0:
+			os.eventfd_write(self.space_ready_fd, 1)
+		return True
+
+def pump_data(src_fd, ring, dest, buffer_size):
+	'''Forwards output from both the ring and src_fd to dest. dest is only flushed when there is
+	nothing more to read, so that a busy writer does not cause a flush for every write.'''
+	fds = [src_fd, ring.data_ready_fd]
+	pending_flush = False
+	while src_fd in fds:
+		if ring.drain(dest):
+			pending_flush = True
+			continue
+
+		if pending_flush:
+			dest.flush()
+			pending_flush = False
+
+		# Ask for a doorbell, and check again in case data arrived in the meantime
+		ring.set_reader_waiting(True)
+		if ring.has_data():
+			ring.set_reader_waiting(False)
+			continue
+
+		readable, _, _ = select.select(fds, [], [], wait_timeout)
+		ring.set_reader_waiting(False)
+		if ring.data_ready_fd in readable:
+			os.eventfd_read(ring.data_ready_fd)
+
+		if src_fd in readable:
+			buffer = os.read(src_fd, buffer_size)
+			if buffer:
+				dest.write(buffer)
+				pending_flush = True
+			else:
+				fds.remove(src_fd)
+
+	if pending_flush:
+		dest.flush()